@@ -0,0 +1,1034 @@
+#ifndef AISDI_MAPS_BTREEMAP_H
+#define AISDI_MAPS_BTREEMAP_H
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Config.h"
+
+namespace aisdi {
+
+    // B+ tree counterpart of TreeMap with the same interface. Elements live
+    // inline, in key order, in leaves of about NODE_BYTES each, and the leaves
+    // are chained both ways, so iterating walks whole blocks. Inner nodes hold
+    // only separator keys and child pointers, so a lookup touches one block per
+    // level instead of one node per key.
+    //
+    // Inserting or removing shifts neighbouring elements and may split or
+    // merge blocks, so either one invalidates iterators and references (unlike
+    // TreeMap).
+    template<typename KeyType, typename ValueType, typename Compare = std::less<KeyType>,
+            typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
+    class BTreeMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using key_compare = Compare;
+        using allocator_type = Allocator;
+
+        class ConstIterator;
+
+        class Iterator;
+
+        using iterator = Iterator;
+        using const_iterator = ConstIterator;
+
+        static const size_type NODE_BYTES = 512;
+        static const size_type LEAF_SLOTS = NODE_BYTES / sizeof(value_type) > 8 ? NODE_BYTES / sizeof(value_type) : 8;
+        static const size_type INNER_SLOTS = NODE_BYTES / (sizeof(key_type) + sizeof(void *)) > 8
+                                             ? NODE_BYTES / (sizeof(key_type) + sizeof(void *)) : 8;
+        static const size_type MIN_LEAF = LEAF_SLOTS / 2;
+        static const size_type MIN_INNER = INNER_SLOTS / 2;
+
+        struct InnerNode;
+
+        struct NodeBase {
+            InnerNode *parent;
+            size_type count;
+            bool leaf;
+        };
+
+        // count elements, in key order
+        struct LeafNode : NodeBase {
+            LeafNode *prev;
+            LeafNode *next;
+            typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type slots[LEAF_SLOTS];
+
+            value_type &at(size_type i) {
+                return *reinterpret_cast<value_type *>(&slots[i]);
+            }
+        };
+
+        // count separator keys and count + 1 children. Every key in child i is
+        // less than key(i), every key in child i + 1 is not.
+        struct InnerNode : NodeBase {
+            typename std::aligned_storage<sizeof(key_type), alignof(key_type)>::type keys[INNER_SLOTS];
+            NodeBase *children[INNER_SLOTS + 1];
+
+            key_type &key(size_type i) {
+                return *reinterpret_cast<key_type *>(&keys[i]);
+            }
+        };
+
+        using LeafAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<LeafNode>;
+        using LeafTraits = std::allocator_traits<LeafAllocator>;
+        using InnerAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<InnerNode>;
+        using InnerTraits = std::allocator_traits<InnerAllocator>;
+
+        NodeBase *root;
+        LeafNode *head;
+        LeafNode *tail;
+        size_type length;
+        Compare compare;
+        LeafAllocator leafAllocator;
+        InnerAllocator innerAllocator;
+
+        BTreeMap(): BTreeMap(Compare(), Allocator()) {}
+
+        explicit BTreeMap(const Allocator &allocator): BTreeMap(Compare(), allocator) {}
+
+        explicit BTreeMap(const Compare &compare, const Allocator &allocator = Allocator())
+                : root(nullptr), head(nullptr), tail(nullptr), length(0), compare(compare),
+                  leafAllocator(allocator), innerAllocator(allocator) {}
+
+        BTreeMap(std::initializer_list<value_type> list): BTreeMap() {
+            for (auto it = list.begin(); it != list.end(); ++it) {
+                insert_or_assign(it->first, it->second);
+            }
+        }
+
+        // The source is already sorted, so the copy is bulk-loaded in one pass.
+        BTreeMap(const BTreeMap &other)
+                : BTreeMap(other.compare,
+                           Allocator(LeafTraits::select_on_container_copy_construction(other.leafAllocator))) {
+            ConstIterator it = other.cbegin();
+            buildSorted(it, other.length);
+        }
+
+        BTreeMap(BTreeMap &&other): BTreeMap() {
+            swapTree(*this, other);
+        }
+
+        ~BTreeMap() {
+            destroySubtree(root);
+        }
+
+        BTreeMap &operator=(BTreeMap other) {
+            swapTree(*this, other);
+            return *this;
+        }
+
+        void swapTree(BTreeMap &a, BTreeMap &b) {
+            std::swap(a.root, b.root);
+            std::swap(a.head, b.head);
+            std::swap(a.tail, b.tail);
+            std::swap(a.length, b.length);
+            std::swap(a.compare, b.compare);
+            std::swap(a.leafAllocator, b.leafAllocator);
+            std::swap(a.innerAllocator, b.innerAllocator);
+        }
+
+        // Builds the map in O(n) from elements whose keys are strictly
+        // increasing; throws std::invalid_argument otherwise.
+        template<typename ForwardIt>
+        static BTreeMap fromSorted(ForwardIt first, ForwardIt last) {
+            return fromSortedN(first, (size_type) std::distance(first, last));
+        }
+
+        template<typename InputIt>
+        static BTreeMap fromSortedN(InputIt first, size_type count) {
+            BTreeMap map;
+            map.buildSorted(first, count);
+            return map;
+        }
+
+        bool isEmpty() const {
+            return length == 0;
+        }
+
+        size_type getSize() const {
+            return length;
+        }
+
+        mapped_type &operator[](const key_type &key) {
+            return try_emplace(key).first->second;
+        }
+
+        mapped_type &operator[](key_type &&key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+            return emplaceUnique(key, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+            return emplaceUnique(std::move(key), std::forward<Args>(args)...);
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+            auto result = emplaceUnique(key, std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+            auto result = emplaceUnique(std::move(key), std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            return findElement(key).second;
+        }
+
+        mapped_type &valueOf(const key_type &key) {
+            return findElement(key).second;
+        }
+
+        const_iterator find(const key_type &key) const {
+            LeafNode *leaf;
+            size_type index;
+
+            if (!lookup(key, leaf, index)) return cend();
+
+            return ConstIterator(this, leaf, index);
+        }
+
+        iterator find(const key_type &key) {
+            return Iterator(static_cast<const BTreeMap *>(this)->find(key));
+        }
+
+        bool contains(const key_type &key) const {
+            LeafNode *leaf;
+            size_type index;
+
+            return lookup(key, leaf, index);
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        // First element whose key is not less than key.
+        const_iterator lower_bound(const key_type &key) const {
+            if (root == nullptr) return cend();
+
+            LeafNode *leaf = findLeaf(key);
+            return positionOf(leaf, leafLowerBound(leaf, key));
+        }
+
+        iterator lower_bound(const key_type &key) {
+            return Iterator(static_cast<const BTreeMap *>(this)->lower_bound(key));
+        }
+
+        // First element whose key is greater than key.
+        const_iterator upper_bound(const key_type &key) const {
+            if (root == nullptr) return cend();
+
+            LeafNode *leaf = findLeaf(key);
+            size_type index = leafLowerBound(leaf, key);
+            if (index < leaf->count && !compare(key, leaf->at(index).first)) ++index;
+
+            return positionOf(leaf, index);
+        }
+
+        iterator upper_bound(const key_type &key) {
+            return Iterator(static_cast<const BTreeMap *>(this)->upper_bound(key));
+        }
+
+        void remove(const key_type &key) {
+            LeafNode *leaf;
+            size_type index;
+
+            if (!lookup(key, leaf, index)) throw std::out_of_range("");
+
+            removeAt(leaf, index);
+        }
+
+        void remove(const const_iterator &it) {
+            if (it.leaf == nullptr) throw std::out_of_range("");
+
+            removeAt(it.leaf, it.index);
+        }
+
+        void clear() {
+            destroySubtree(root);
+            root = nullptr;
+            head = tail = nullptr;
+            length = 0;
+        }
+
+        bool operator==(const BTreeMap &other) const {
+            if (length != other.length) return false;
+
+            for (ConstIterator it1 = cbegin(), it2 = other.cbegin(); it1 != cend(); ++it1, ++it2) {
+                if (it1->first != it2->first || it1->second != it2->second) return false;
+            }
+
+            return true;
+        }
+
+        bool operator!=(const BTreeMap &other) const {
+            return !(*this == other);
+        }
+
+        iterator begin() {
+            return Iterator(cbegin());
+        }
+
+        iterator end() {
+            return Iterator(cend());
+        }
+
+        const_iterator cbegin() const {
+            return ConstIterator(this, head, 0);
+        }
+
+        const_iterator cend() const {
+            return ConstIterator(this, nullptr, 0);
+        }
+
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        const_iterator end() const {
+            return cend();
+        }
+
+        allocator_type getAllocator() const {
+            return allocator_type(leafAllocator);
+        }
+
+        // Index of the child of node that may hold key.
+        size_type childIndex(InnerNode *node, const key_type &key) const {
+            size_type low = 0;
+            size_type high = node->count;
+
+            while (low < high) {
+                size_type middle = (low + high) / 2;
+
+                if (compare(key, node->key(middle))) high = middle;
+                else low = middle + 1;
+            }
+
+            return low;
+        }
+
+        LeafNode *findLeaf(const key_type &key) const {
+            NodeBase *node = root;
+
+            while (!node->leaf) {
+                InnerNode *inner = static_cast<InnerNode *>(node);
+                node = inner->children[childIndex(inner, key)];
+            }
+
+            return static_cast<LeafNode *>(node);
+        }
+
+        // Position of the first element of leaf whose key is not less than key.
+        size_type leafLowerBound(LeafNode *leaf, const key_type &key) const {
+            size_type low = 0;
+            size_type high = leaf->count;
+
+            while (low < high) {
+                size_type middle = (low + high) / 2;
+
+                if (compare(leaf->at(middle).first, key)) low = middle + 1;
+                else high = middle;
+            }
+
+            return low;
+        }
+
+        bool lookup(const key_type &key, LeafNode *&leaf, size_type &index) const {
+            if (root == nullptr) return false;
+
+            leaf = findLeaf(key);
+            index = leafLowerBound(leaf, key);
+
+            return index < leaf->count && !compare(key, leaf->at(index).first);
+        }
+
+        value_type &findElement(const key_type &key) const {
+            LeafNode *leaf;
+            size_type index;
+
+            if (!lookup(key, leaf, index)) throw std::out_of_range("");
+
+            return leaf->at(index);
+        }
+
+        // A position one past the end of a leaf is the start of the next one.
+        const_iterator positionOf(LeafNode *leaf, size_type index) const {
+            if (index == leaf->count) return ConstIterator(this, leaf->next, 0);
+
+            return ConstIterator(this, leaf, index);
+        }
+
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceUnique(K &&key, Args &&... args) {
+            if (root == nullptr) root = head = tail = createLeaf();
+
+            LeafNode *leaf = findLeaf(key);
+            size_type index = leafLowerBound(leaf, key);
+
+            if (index < leaf->count && !compare(key, leaf->at(index).first))
+                return std::make_pair(Iterator(ConstIterator(this, leaf, index)), false);
+
+            if (leaf->count == LEAF_SLOTS) {
+                LeafNode *right = splitLeaf(leaf);
+
+                if (index > leaf->count) {
+                    index -= leaf->count;
+                    leaf = right;
+                }
+            }
+
+            openSlot(leaf, index);
+
+            try {
+                new (&leaf->at(index)) value_type(std::piecewise_construct,
+                                                  std::forward_as_tuple(std::forward<K>(key)),
+                                                  std::forward_as_tuple(std::forward<Args>(args)...));
+            }
+            catch (...) {
+                closeSlot(leaf, index);
+                throw;
+            }
+
+            ++length;
+            return std::make_pair(Iterator(ConstIterator(this, leaf, index)), true);
+        }
+
+        // Shifts elements from index on one slot right, leaving index unconstructed.
+        void openSlot(LeafNode *leaf, size_type index) {
+            for (size_type i = leaf->count; i > index; --i) {
+                new (&leaf->at(i)) value_type(std::move(leaf->at(i - 1)));
+                leaf->at(i - 1).~value_type();
+            }
+
+            ++leaf->count;
+        }
+
+        // Undoes openSlot: the unconstructed slot at index is closed up.
+        void closeSlot(LeafNode *leaf, size_type index) {
+            for (size_type i = index + 1; i < leaf->count; ++i) {
+                new (&leaf->at(i - 1)) value_type(std::move(leaf->at(i)));
+                leaf->at(i).~value_type();
+            }
+
+            --leaf->count;
+        }
+
+        // Moves the upper half of a full leaf into a new right sibling. The
+        // separator copy and every node the split needs upwards come first,
+        // so if any of them throws the tree is left as it was.
+        LeafNode *splitLeaf(LeafNode *leaf) {
+            size_type keep = LEAF_SLOTS / 2;
+            key_type separator(leaf->at(keep).first);
+            InnerNode *spares = reserveInners(leaf);
+            LeafNode *right;
+
+            try {
+                right = createLeaf();
+            }
+            catch (...) {
+                releaseInners(spares);
+                throw;
+            }
+
+            for (size_type i = keep; i < leaf->count; ++i) {
+                new (&right->at(i - keep)) value_type(std::move(leaf->at(i)));
+                leaf->at(i).~value_type();
+            }
+
+            right->count = leaf->count - keep;
+            leaf->count = keep;
+
+            right->prev = leaf;
+            right->next = leaf->next;
+            if (leaf->next != nullptr) leaf->next->prev = right;
+            else tail = right;
+            leaf->next = right;
+
+            insertIntoParent(leaf, std::move(separator), right, spares);
+            return right;
+        }
+
+        // Allocates the inner nodes a split below node can take: one for each
+        // full ancestor and a new root if they are all full. The spares are
+        // chained through parent.
+        InnerNode *reserveInners(NodeBase *node) {
+            InnerNode *spares = nullptr;
+
+            try {
+                for (InnerNode *parent = node->parent; ; parent = parent->parent) {
+                    if (parent != nullptr && parent->count < INNER_SLOTS) break;
+
+                    InnerNode *spare = createInner();
+                    spare->parent = spares;
+                    spares = spare;
+
+                    if (parent == nullptr) break;
+                }
+            }
+            catch (...) {
+                releaseInners(spares);
+                throw;
+            }
+
+            return spares;
+        }
+
+        static InnerNode *takeInner(InnerNode *&spares) {
+            InnerNode *inner = spares;
+            spares = inner->parent;
+            inner->parent = nullptr;
+            return inner;
+        }
+
+        void releaseInners(InnerNode *spares) {
+            while (spares != nullptr) destroyInner(takeInner(spares));
+        }
+
+        // Hangs right next to left under their parent, separated by key,
+        // splitting the parent (and so on upwards) if it is full. The nodes
+        // that takes come from spares, so nothing here allocates.
+        void insertIntoParent(NodeBase *left, key_type &&key, NodeBase *right, InnerNode *&spares) {
+            InnerNode *parent = left->parent;
+
+            if (parent == nullptr) {
+                InnerNode *newRoot = takeInner(spares);
+                new (&newRoot->key(0)) key_type(std::move(key));
+                newRoot->children[0] = left;
+                newRoot->children[1] = right;
+                newRoot->count = 1;
+
+                left->parent = right->parent = newRoot;
+                root = newRoot;
+                return;
+            }
+
+            if (parent->count == INNER_SLOTS) {
+                splitInner(parent, spares);
+                parent = left->parent;
+            }
+
+            size_type index = indexInParent(left);
+
+            for (size_type i = parent->count; i > index; --i) {
+                new (&parent->key(i)) key_type(std::move(parent->key(i - 1)));
+                parent->key(i - 1).~key_type();
+                parent->children[i + 1] = parent->children[i];
+            }
+
+            new (&parent->key(index)) key_type(std::move(key));
+            parent->children[index + 1] = right;
+            right->parent = parent;
+            ++parent->count;
+        }
+
+        // Moves the upper half of a full inner node into a new right sibling;
+        // the middle key moves up to the parent.
+        void splitInner(InnerNode *node, InnerNode *&spares) {
+            InnerNode *right = takeInner(spares);
+            size_type middle = node->count / 2;
+
+            for (size_type i = middle + 1; i < node->count; ++i) {
+                new (&right->key(i - middle - 1)) key_type(std::move(node->key(i)));
+                node->key(i).~key_type();
+            }
+
+            for (size_type i = middle + 1; i <= node->count; ++i) {
+                right->children[i - middle - 1] = node->children[i];
+                node->children[i]->parent = right;
+            }
+
+            right->count = node->count - middle - 1;
+            node->count = middle;
+
+            key_type separator(std::move(node->key(middle)));
+            node->key(middle).~key_type();
+
+            insertIntoParent(node, std::move(separator), right, spares);
+        }
+
+        size_type indexInParent(NodeBase *node) const {
+            InnerNode *parent = node->parent;
+            size_type index = 0;
+
+            while (parent->children[index] != node) ++index;
+
+            return index;
+        }
+
+        void removeAt(LeafNode *leaf, size_type index) {
+            leaf->at(index).~value_type();
+            closeSlot(leaf, index);
+            --length;
+
+            if (leaf == root) {
+                if (leaf->count == 0) {
+                    destroyLeaf(leaf);
+                    root = head = tail = nullptr;
+                }
+                return;
+            }
+
+            // a stale separator is still a valid one, so removing the first
+            // element of a leaf needs no fix-up above it
+            if (leaf->count < MIN_LEAF) rebalanceLeaf(leaf);
+        }
+
+        void rebalanceLeaf(LeafNode *leaf) {
+            InnerNode *parent = leaf->parent;
+            size_type index = indexInParent(leaf);
+            LeafNode *left = index > 0 ? static_cast<LeafNode *>(parent->children[index - 1]) : nullptr;
+            LeafNode *right = index < parent->count ? static_cast<LeafNode *>(parent->children[index + 1]) : nullptr;
+
+            if (left != nullptr && left->count > MIN_LEAF) {
+                openSlot(leaf, 0);
+                new (&leaf->at(0)) value_type(std::move(left->at(left->count - 1)));
+                left->at(left->count - 1).~value_type();
+                --left->count;
+
+                replaceKey(parent, index - 1, leaf->at(0).first);
+                return;
+            }
+
+            if (right != nullptr && right->count > MIN_LEAF) {
+                new (&leaf->at(leaf->count)) value_type(std::move(right->at(0)));
+                ++leaf->count;
+                right->at(0).~value_type();
+                closeSlot(right, 0);
+
+                replaceKey(parent, index, right->at(0).first);
+                return;
+            }
+
+            if (left != nullptr) mergeLeaves(left, leaf, index - 1);
+            else mergeLeaves(leaf, right, index);
+
+            rebalanceInner(parent);
+        }
+
+        // Appends right to left and drops right along with separator keyIndex.
+        void mergeLeaves(LeafNode *left, LeafNode *right, size_type keyIndex) {
+            for (size_type i = 0; i < right->count; ++i) {
+                new (&left->at(left->count + i)) value_type(std::move(right->at(i)));
+                right->at(i).~value_type();
+            }
+
+            left->count += right->count;
+            right->count = 0;
+
+            left->next = right->next;
+            if (right->next != nullptr) right->next->prev = left;
+            else tail = left;
+
+            removeFromInner(left->parent, keyIndex);
+            destroyLeaf(right);
+        }
+
+        // Drops key keyIndex and the child to its right.
+        void removeFromInner(InnerNode *node, size_type keyIndex) {
+            node->key(keyIndex).~key_type();
+
+            for (size_type i = keyIndex + 1; i < node->count; ++i) {
+                new (&node->key(i - 1)) key_type(std::move(node->key(i)));
+                node->key(i).~key_type();
+                node->children[i] = node->children[i + 1];
+            }
+
+            --node->count;
+        }
+
+        void replaceKey(InnerNode *node, size_type index, const key_type &key) {
+            key_type copy(key);
+            node->key(index).~key_type();
+            new (&node->key(index)) key_type(std::move(copy));
+        }
+
+        void rebalanceInner(InnerNode *node) {
+            if (node == root) {
+                if (node->count == 0) {
+                    root = node->children[0];
+                    root->parent = nullptr;
+                    destroyInner(node);
+                }
+                return;
+            }
+
+            if (node->count >= MIN_INNER) return;
+
+            InnerNode *parent = node->parent;
+            size_type index = indexInParent(node);
+            InnerNode *left = index > 0 ? static_cast<InnerNode *>(parent->children[index - 1]) : nullptr;
+            InnerNode *right = index < parent->count ? static_cast<InnerNode *>(parent->children[index + 1]) : nullptr;
+
+            if (left != nullptr && left->count > MIN_INNER) {
+                // rotate right through the parent
+                for (size_type i = node->count; i > 0; --i) {
+                    new (&node->key(i)) key_type(std::move(node->key(i - 1)));
+                    node->key(i - 1).~key_type();
+                }
+                for (size_type i = node->count + 1; i > 0; --i) node->children[i] = node->children[i - 1];
+
+                new (&node->key(0)) key_type(std::move(parent->key(index - 1)));
+                parent->key(index - 1).~key_type();
+                new (&parent->key(index - 1)) key_type(std::move(left->key(left->count - 1)));
+                left->key(left->count - 1).~key_type();
+
+                node->children[0] = left->children[left->count];
+                node->children[0]->parent = node;
+                --left->count;
+                ++node->count;
+                return;
+            }
+
+            if (right != nullptr && right->count > MIN_INNER) {
+                // rotate left through the parent
+                new (&node->key(node->count)) key_type(std::move(parent->key(index)));
+                parent->key(index).~key_type();
+                new (&parent->key(index)) key_type(std::move(right->key(0)));
+                right->key(0).~key_type();
+
+                node->children[node->count + 1] = right->children[0];
+                node->children[node->count + 1]->parent = node;
+                ++node->count;
+
+                for (size_type i = 1; i < right->count; ++i) {
+                    new (&right->key(i - 1)) key_type(std::move(right->key(i)));
+                    right->key(i).~key_type();
+                }
+                for (size_type i = 0; i < right->count; ++i) right->children[i] = right->children[i + 1];
+                --right->count;
+                return;
+            }
+
+            if (left != nullptr) mergeInner(left, node, index - 1);
+            else mergeInner(node, right, index);
+
+            rebalanceInner(parent);
+        }
+
+        // Pulls separator keyIndex down into left and appends right to it.
+        void mergeInner(InnerNode *left, InnerNode *right, size_type keyIndex) {
+            InnerNode *parent = left->parent;
+
+            new (&left->key(left->count)) key_type(parent->key(keyIndex));
+
+            for (size_type i = 0; i < right->count; ++i) {
+                new (&left->key(left->count + 1 + i)) key_type(std::move(right->key(i)));
+            }
+
+            for (size_type i = 0; i <= right->count; ++i) {
+                left->children[left->count + 1 + i] = right->children[i];
+                right->children[i]->parent = left;
+            }
+
+            left->count += right->count + 1;
+
+            removeFromInner(parent, keyIndex);
+            destroyInner(right);
+        }
+
+        // Replaces the (empty) tree with count sorted elements. Leaves and inner
+        // nodes are filled evenly, so each level is as full as it can be while
+        // keeping every node at least half full.
+        template<typename InputIt>
+        void buildSorted(InputIt &first, size_type count) {
+            if (count == 0) return;
+
+            std::vector<NodeBase *> level;
+            std::vector<const key_type *> lowKeys;
+            std::vector<InnerNode *> inners;
+            size_type leafCount = (count + LEAF_SLOTS - 1) / LEAF_SLOTS;
+
+            try {
+                for (size_type i = 0; i < leafCount; ++i) {
+                    LeafNode *leaf = createLeaf();
+                    leaf->prev = tail;
+                    if (tail != nullptr) tail->next = leaf;
+                    else head = leaf;
+                    tail = leaf;
+
+                    size_type take = count / leafCount + (i < count % leafCount ? 1 : 0);
+
+                    for (; leaf->count < take; ++leaf->count, ++first) {
+                        new (&leaf->at(leaf->count)) value_type(*first);
+
+                        const key_type &key = leaf->at(leaf->count).first;
+                        const key_type *previous = leaf->count > 0 ? &leaf->at(leaf->count - 1).first
+                                                                   : (leaf->prev != nullptr ? &leaf->prev->at(leaf->prev->count - 1).first : nullptr);
+
+                        if (previous != nullptr && !compare(*previous, key)) {
+                            leaf->at(leaf->count).~value_type();
+                            throw std::invalid_argument("");
+                        }
+                    }
+
+                    length += take;
+                    level.push_back(leaf);
+                    lowKeys.push_back(&leaf->at(0).first);
+                }
+
+                while (level.size() > 1) {
+                    std::vector<NodeBase *> upper;
+                    std::vector<const key_type *> upperKeys;
+                    size_type nodeCount = (level.size() + INNER_SLOTS) / (INNER_SLOTS + 1);
+                    size_type next = 0;
+
+                    for (size_type i = 0; i < nodeCount; ++i) {
+                        inners.push_back(nullptr);
+                        InnerNode *inner = inners.back() = createInner();
+                        upper.push_back(inner);
+                        upperKeys.push_back(lowKeys[next]);
+
+                        size_type take = level.size() / nodeCount + (i < level.size() % nodeCount ? 1 : 0);
+
+                        for (size_type j = 0; j < take; ++j, ++next) {
+                            if (j > 0) {
+                                new (&inner->key(j - 1)) key_type(*lowKeys[next]);
+                                inner->count = j;
+                            }
+                            inner->children[j] = level[next];
+                            level[next]->parent = inner;
+                        }
+                    }
+
+                    level.swap(upper);
+                    lowKeys.swap(upperKeys);
+                }
+
+                root = level[0];
+            }
+            catch (...) {
+                // the tree may be half linked; every leaf is on the chain and
+                // every inner node in inners
+                for (LeafNode *leaf = head; leaf != nullptr;) {
+                    LeafNode *next = leaf->next;
+                    destroyLeaf(leaf);
+                    leaf = next;
+                }
+
+                for (InnerNode *inner : inners) {
+                    if (inner != nullptr) destroyInner(inner);
+                }
+
+                root = head = tail = nullptr;
+                length = 0;
+                throw;
+            }
+        }
+
+        void destroySubtree(NodeBase *node) {
+            if (node == nullptr) return;
+
+            if (node->leaf) {
+                destroyLeaf(static_cast<LeafNode *>(node));
+                return;
+            }
+
+            InnerNode *inner = static_cast<InnerNode *>(node);
+            for (size_type i = 0; i <= inner->count; ++i) destroySubtree(inner->children[i]);
+            destroyInner(inner);
+        }
+
+        LeafNode *createLeaf() {
+            LeafNode *leaf = LeafTraits::allocate(leafAllocator, 1);
+            leaf->parent = nullptr;
+            leaf->count = 0;
+            leaf->leaf = true;
+            leaf->prev = leaf->next = nullptr;
+            return leaf;
+        }
+
+        InnerNode *createInner() {
+            InnerNode *inner = InnerTraits::allocate(innerAllocator, 1);
+            inner->parent = nullptr;
+            inner->count = 0;
+            inner->leaf = false;
+            inner->children[0] = nullptr;
+            return inner;
+        }
+
+        void destroyLeaf(LeafNode *leaf) {
+            for (size_type i = 0; i < leaf->count; ++i) leaf->at(i).~value_type();
+            LeafTraits::deallocate(leafAllocator, leaf, 1);
+        }
+
+        void destroyInner(InnerNode *inner) {
+            for (size_type i = 0; i < inner->count; ++i) inner->key(i).~key_type();
+            InnerTraits::deallocate(innerAllocator, inner, 1);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    class BTreeMap<KeyType, ValueType, Compare, Allocator>::ConstIterator {
+    public:
+        using reference = typename BTreeMap::const_reference;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename BTreeMap::value_type;
+        using pointer = const typename BTreeMap::value_type *;
+
+        const BTreeMap *map;
+        LeafNode *leaf;
+        size_type index;
+
+        explicit ConstIterator() {
+            map = nullptr;
+            leaf = nullptr;
+            index = 0;
+        }
+
+        ConstIterator(const BTreeMap *map, LeafNode *leaf, size_type index) {
+            this->map = map;
+            this->leaf = leaf;
+            this->index = index;
+        }
+
+        ConstIterator(const ConstIterator &other) {
+            map = other.map;
+            leaf = other.leaf;
+            index = other.index;
+        }
+
+        ConstIterator &operator++() {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (leaf == nullptr) throw std::out_of_range("");
+#endif
+
+            if (++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator it(*this);
+            this->operator++();
+            return it;
+        }
+
+        ConstIterator &operator--() {
+            if (leaf == nullptr) {
+#if AISDI_MAPS_CHECKED_ITERATORS
+                if (map->tail == nullptr) throw std::out_of_range("");
+#endif
+
+                leaf = map->tail;
+                index = leaf->count - 1;
+            }
+            else if (index > 0) {
+                --index;
+            }
+            else {
+#if AISDI_MAPS_CHECKED_ITERATORS
+                if (leaf->prev == nullptr) throw std::out_of_range("");
+#endif
+
+                leaf = leaf->prev;
+                index = leaf->count - 1;
+            }
+
+            return *this;
+        }
+
+        ConstIterator operator--(int) {
+            ConstIterator it(*this);
+            this->operator--();
+            return it;
+        }
+
+        reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (leaf == nullptr) throw std::out_of_range("");
+#endif
+
+            return leaf->at(index);
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        bool operator==(const ConstIterator &other) const {
+            return leaf == other.leaf && index == other.index;
+        }
+
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    class BTreeMap<KeyType, ValueType, Compare, Allocator>::Iterator
+            : public BTreeMap<KeyType, ValueType, Compare, Allocator>::ConstIterator {
+    public:
+        using reference = typename BTreeMap::reference;
+        using pointer = typename BTreeMap::value_type *;
+
+        explicit Iterator() {}
+
+        Iterator(const ConstIterator &other)
+                : ConstIterator(other) {}
+
+        Iterator &operator++() {
+            ConstIterator::operator++();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto result = *this;
+            ConstIterator::operator++();
+            return result;
+        }
+
+        Iterator &operator--() {
+            ConstIterator::operator--();
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            auto result = *this;
+            ConstIterator::operator--();
+            return result;
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        reference operator*() const {
+            // ugly cast, yet reduces code duplication.
+            return const_cast<reference>(ConstIterator::operator*());
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_BTREEMAP_H */
@@ -0,0 +1,244 @@
+#ifndef AISDI_MAPS_CONCURRENTHASHMAP_H
+#define AISDI_MAPS_CONCURRENTHASHMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#if __cplusplus >= 201402L
+#include <shared_mutex>
+#endif
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "HashMap.h"
+
+namespace aisdi {
+
+    // HashMap split into independently locked shards, for many reader and
+    // writer threads. The upper bits of the (remixed) hash pick the shard and
+    // each shard's HashMap spreads keys over its buckets with the lower bits,
+    // so the two choices stay independent. Readers of one shard share its lock
+    // (from C++14 on); threads working on different shards never touch the
+    // same lock.
+    //
+    // Nothing hands out references or iterators into the map, since another
+    // thread could remove the element behind them: lookups copy the value out
+    // and in-place updates go through compute(), which runs under the lock.
+    template<typename KeyType, typename ValueType,
+            typename Hash = FastHash<KeyType>, typename KeyEqual = std::equal_to<KeyType>,
+            typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
+    class ConcurrentHashMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+        using map_type = HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>;
+
+        // Shared locks need C++14; under C++11 each shard has a plain mutex,
+        // so readers of one shard take turns like writers do.
+#if __cplusplus >= 201703L
+        using Lock = std::shared_mutex;
+        using ReadGuard = std::shared_lock<Lock>;
+#elif __cplusplus >= 201402L
+        using Lock = std::shared_timed_mutex;
+        using ReadGuard = std::shared_lock<Lock>;
+#else
+        using Lock = std::mutex;
+        using ReadGuard = std::unique_lock<Lock>;
+#endif
+
+        struct Shard {
+            mutable Lock lock;
+            map_type map;
+            // keeps the next shard's lock off this shard's cache line
+            char padding[64];
+
+            Shard(const Hash &hash, const KeyEqual &equal, const Allocator &allocator)
+                    : map(hash, equal, allocator) {}
+        };
+
+        Shard *shards;
+        size_type shardCount;
+        unsigned shardShift;
+        Hash hashFunction;
+
+        // shardCount is rounded up to a power of two; 0 picks four shards per
+        // hardware thread.
+        explicit ConcurrentHashMap(size_type shardCount = 0, const Hash &hash = Hash(),
+                                   const KeyEqual &equal = KeyEqual(), const Allocator &allocator = Allocator())
+                : hashFunction(hash) {
+            if (shardCount == 0) shardCount = 4 * (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4);
+
+            this->shardCount = 1;
+            shardShift = 64;
+            while (this->shardCount < shardCount) {
+                this->shardCount *= 2;
+                --shardShift;
+            }
+
+            shards = static_cast<Shard *>(::operator new(this->shardCount * sizeof(Shard)));
+            size_type built = 0;
+
+            try {
+                for (; built < this->shardCount; ++built) new (&shards[built]) Shard(hash, equal, allocator);
+            }
+            catch (...) {
+                while (built > 0) shards[--built].~Shard();
+                ::operator delete(shards);
+                throw;
+            }
+        }
+
+        ~ConcurrentHashMap() {
+            for (size_type i = 0; i < shardCount; ++i) shards[i].~Shard();
+            ::operator delete(shards);
+        }
+
+        ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+
+        ConcurrentHashMap &operator=(const ConcurrentHashMap &) = delete;
+
+        Shard &shardFor(const key_type &key) const {
+            // Fibonacci hashing: std::hash<int> is the identity, whose upper
+            // bits would put every small key into shard 0
+            std::uint64_t mixed = (std::uint64_t) hashFunction(key) * 0x9E3779B97F4A7C15ull;
+            return shards[shardCount == 1 ? 0 : (size_type) (mixed >> shardShift)];
+        }
+
+        bool find(const key_type &key, mapped_type &out) const {
+            Shard &shard = shardFor(key);
+            ReadGuard guard(shard.lock);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.end()) return false;
+
+            out = it->second;
+            return true;
+        }
+
+        mapped_type valueOf(const key_type &key) const {
+            Shard &shard = shardFor(key);
+            ReadGuard guard(shard.lock);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.end()) throw std::out_of_range("");
+
+            return it->second;
+        }
+
+        bool contains(const key_type &key) const {
+            Shard &shard = shardFor(key);
+            ReadGuard guard(shard.lock);
+
+            return shard.map.contains(key);
+        }
+
+        // Adds the element unless the key is already there; returns whether it did.
+        template<typename... Args>
+        bool insert(const key_type &key, Args &&... args) {
+            Shard &shard = shardFor(key);
+            std::unique_lock<Lock> guard(shard.lock);
+
+            return shard.map.try_emplace(key, std::forward<Args>(args)...).second;
+        }
+
+        template<typename M>
+        bool insert_or_assign(const key_type &key, M &&obj) {
+            Shard &shard = shardFor(key);
+            std::unique_lock<Lock> guard(shard.lock);
+
+            return shard.map.insert_or_assign(key, std::forward<M>(obj)).second;
+        }
+
+        // Unlike HashMap::remove a missing key is not an error here: another
+        // thread may have removed it first.
+        bool remove(const key_type &key) {
+            Shard &shard = shardFor(key);
+            std::unique_lock<Lock> guard(shard.lock);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.end()) return false;
+
+            shard.map.remove(it);
+            return true;
+        }
+
+        // Runs update(mapped_type &) on the key's value, value-initializing it
+        // first if the key is missing, and returns whatever update returns. The
+        // shard stays locked for the call, so update must not touch this map.
+        template<typename Update>
+        auto compute(const key_type &key, Update update) -> decltype(update(std::declval<mapped_type &>())) {
+            Shard &shard = shardFor(key);
+            std::unique_lock<Lock> guard(shard.lock);
+
+            return update(shard.map.try_emplace(key).first->second);
+        }
+
+        // Like compute, but leaves a missing key alone; returns whether it ran.
+        template<typename Update>
+        bool computeIfPresent(const key_type &key, Update update) {
+            Shard &shard = shardFor(key);
+            std::unique_lock<Lock> guard(shard.lock);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.end()) return false;
+
+            update(it->second);
+            return true;
+        }
+
+        // Visits every element one shard at a time, so the walk sees each
+        // shard consistently but not the map as a whole.
+        template<typename Visit>
+        void forEach(Visit visit) const {
+            for (size_type i = 0; i < shardCount; ++i) {
+                ReadGuard guard(shards[i].lock);
+
+                for (auto it = shards[i].map.cbegin(); it != shards[i].map.cend(); ++it) visit(*it);
+            }
+        }
+
+        size_type getSize() const {
+            size_type size = 0;
+
+            for (size_type i = 0; i < shardCount; ++i) {
+                ReadGuard guard(shards[i].lock);
+                size += shards[i].map.getSize();
+            }
+
+            return size;
+        }
+
+        bool isEmpty() const {
+            return getSize() == 0;
+        }
+
+        void clear() {
+            for (size_type i = 0; i < shardCount; ++i) {
+                std::unique_lock<Lock> guard(shards[i].lock);
+                shards[i].map.clear();
+            }
+        }
+
+        void reserve(size_type n) {
+            size_type perShard = (n + shardCount - 1) / shardCount;
+
+            for (size_type i = 0; i < shardCount; ++i) {
+                std::unique_lock<Lock> guard(shards[i].lock);
+                shards[i].map.reserve(perShard + perShard / 8);
+            }
+        }
+
+        size_type getShardCount() const {
+            return shardCount;
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_CONCURRENTHASHMAP_H */
@@ -0,0 +1,539 @@
+#ifndef AISDI_MAPS_CONCURRENTTREEMAP_H
+#define AISDI_MAPS_CONCURRENTTREEMAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Config.h"
+
+namespace aisdi {
+
+    // Ordered map for read-mostly data shared between threads. Readers never
+    // block: they take a Snapshot, which pins the current root, and walk a tree
+    // nobody will ever modify. Writers are serialized by a mutex and never touch
+    // a published node either. They copy the path from the root to the change
+    // (an AVL tree, so O(log n) copies), publish the new root with one atomic
+    // store and wait out a grace period before freeing the nodes they replaced.
+    //
+    // The grace period works like SRCU: each reader bumps one of two sets of
+    // striped counters, picked by the current parity, for as long as it holds
+    // its snapshot. The writer flips the parity and waits for the old set to
+    // drain, twice, so that a reader which read the parity just before a flip
+    // is still waited for. Writers pay for that wait; readers only pay for an
+    // uncontended atomic increment and decrement.
+    //
+    // Keys and values are copied along the path on every write, so both have to
+    // be copy constructible.
+    template<typename KeyType, typename ValueType, typename Compare = std::less<KeyType>>
+    class ConcurrentTreeMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+        using const_reference = const value_type &;
+        using key_compare = Compare;
+
+        class Node;
+
+        class ConstIterator;
+
+        class Snapshot;
+
+        using const_iterator = ConstIterator;
+
+        static const size_type READER_STRIPES = 16;
+
+        struct ReaderCounter {
+            std::atomic<long> active;
+            // one counter per cache line, so readers on different stripes do
+            // not bounce each other's lines
+            char padding[64 - sizeof(std::atomic<long>)];
+        };
+
+        std::atomic<const Node *> root;
+        std::atomic<size_type> length;
+        std::atomic<unsigned> parity;
+        mutable ReaderCounter readers[2][READER_STRIPES];
+        std::mutex writeLock;
+        // nodes the write in progress replaces, freed once its root is
+        // published and the grace period is over
+        std::vector<const Node *> retired;
+        // nodes the write in progress built, freed if it fails
+        std::vector<const Node *> created;
+        Compare compare;
+
+        explicit ConcurrentTreeMap(const Compare &compare = Compare()): compare(compare) {
+            root.store(nullptr);
+            length.store(0);
+            parity.store(0);
+
+            for (unsigned p = 0; p < 2; ++p) {
+                for (size_type i = 0; i < READER_STRIPES; ++i) readers[p][i].active.store(0);
+            }
+        }
+
+        ConcurrentTreeMap(std::initializer_list<value_type> list): ConcurrentTreeMap() {
+            for (auto it = list.begin(); it != list.end(); ++it) insert_or_assign(it->first, it->second);
+        }
+
+        ConcurrentTreeMap(const ConcurrentTreeMap &) = delete;
+
+        ConcurrentTreeMap &operator=(const ConcurrentTreeMap &) = delete;
+
+        // Nobody can be reading any more, so no grace period is needed.
+        ~ConcurrentTreeMap() {
+            destroySubtree(root.load());
+            freeRetired();
+        }
+
+        Snapshot snapshot() const {
+            return Snapshot(this);
+        }
+
+        bool find(const key_type &key, mapped_type &out) const {
+            Snapshot view(this);
+            const Node *node = view.lookup(key);
+
+            if (node == nullptr) return false;
+
+            out = node->value.second;
+            return true;
+        }
+
+        mapped_type valueOf(const key_type &key) const {
+            Snapshot view(this);
+            return view.valueOf(key);
+        }
+
+        bool contains(const key_type &key) const {
+            Snapshot view(this);
+            return view.contains(key);
+        }
+
+        size_type getSize() const {
+            return length.load();
+        }
+
+        bool isEmpty() const {
+            return getSize() == 0;
+        }
+
+        // Adds the element unless the key is already there; returns whether it did.
+        bool insert(const key_type &key, const mapped_type &value) {
+            return write(key, &value, false);
+        }
+
+        // Returns true if the key was new, false if its value was replaced.
+        bool insert_or_assign(const key_type &key, const mapped_type &value) {
+            return write(key, &value, true);
+        }
+
+        // A missing key is not an error: another thread may have removed it.
+        bool remove(const key_type &key) {
+            std::lock_guard<std::mutex> guard(writeLock);
+            bool removed = false;
+            const Node *newRoot = change([&]() { return removeFrom(root.load(), key, removed); });
+
+            if (!removed) return false;
+
+            publish(newRoot);
+            length.fetch_sub(1);
+            return true;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> guard(writeLock);
+            const Node *oldRoot = root.load();
+
+            if (oldRoot == nullptr) return;
+
+            root.store(nullptr);
+            length.store(0);
+            synchronize();
+            destroySubtree(oldRoot);
+            freeRetired();
+        }
+
+        bool write(const key_type &key, const mapped_type *value, bool assign) {
+            std::lock_guard<std::mutex> guard(writeLock);
+            bool inserted = false;
+            const Node *oldRoot = root.load();
+            const Node *newRoot = change([&]() { return insertInto(oldRoot, key, *value, assign, inserted); });
+
+            if (newRoot == oldRoot) return false;
+
+            publish(newRoot);
+            if (inserted) length.fetch_add(1);
+            return inserted;
+        }
+
+        // Builds the new version of the tree with copy. Until its root is
+        // published nothing is shared, so if copy throws, the nodes it built
+        // are freed and the ones it meant to retire stay where they are.
+        // Called with writeLock held.
+        template<typename Copy>
+        const Node *change(Copy copy) {
+            try {
+                return copy();
+            }
+            catch (...) {
+                for (const Node *node : created) delete node;
+                created.clear();
+                retired.clear();
+                throw;
+            }
+        }
+
+        // Called with writeLock held.
+        void publish(const Node *newRoot) {
+            root.store(newRoot);
+            created.clear();
+            synchronize();
+            freeRetired();
+        }
+
+        // Returns once every reader that could have seen the previous root
+        // has dropped its snapshot.
+        void synchronize() {
+            for (int phase = 0; phase < 2; ++phase) {
+                unsigned old = parity.load();
+                parity.store(old ^ 1u);
+
+                while (activeReaders(old) != 0) std::this_thread::yield();
+            }
+        }
+
+        long activeReaders(unsigned set) const {
+            long total = 0;
+
+            for (size_type i = 0; i < READER_STRIPES; ++i) total += readers[set][i].active.load();
+
+            return total;
+        }
+
+        static size_type readerStripe() {
+            static std::atomic<size_type> nextStripe(0);
+            static thread_local size_type stripe = nextStripe.fetch_add(1) % READER_STRIPES;
+            return stripe;
+        }
+
+        static int height(const Node *node) {
+            return node == nullptr ? 0 : node->height;
+        }
+
+        const Node *createNode(const key_type &key, const mapped_type &value, const Node *left, const Node *right) {
+            const Node *node = new Node(key, value, left, right);
+
+            try {
+                created.push_back(node);
+            }
+            catch (...) {
+                delete node;
+                throw;
+            }
+
+            return node;
+        }
+
+        // Copies from with new children. from is replaced, so it goes to the
+        // retired list even if it was never published.
+        const Node *rebuild(const Node *from, const Node *left, const Node *right) {
+            retired.push_back(from);
+            return createNode(from->value.first, from->value.second, left, right);
+        }
+
+        // Builds a node holding from's element over left and right, whose
+        // heights may differ by two, rotating into AVL shape if they do.
+        const Node *join(const Node *from, const Node *left, const Node *right) {
+            int leftHeight = height(left);
+            int rightHeight = height(right);
+
+            if (leftHeight > rightHeight + 1) {
+                if (height(left->left) >= height(left->right)) {
+                    return rebuild(left, left->left, rebuild(from, left->right, right));
+                }
+
+                const Node *pivot = left->right;
+                return rebuild(pivot, rebuild(left, left->left, pivot->left), rebuild(from, pivot->right, right));
+            }
+
+            if (rightHeight > leftHeight + 1) {
+                if (height(right->right) >= height(right->left)) {
+                    return rebuild(right, rebuild(from, left, right->left), right->right);
+                }
+
+                const Node *pivot = right->left;
+                return rebuild(pivot, rebuild(from, left, pivot->left), rebuild(right, pivot->right, right->right));
+            }
+
+            return rebuild(from, left, right);
+        }
+
+        // Returns node itself when nothing changed.
+        const Node *insertInto(const Node *node, const key_type &key, const mapped_type &value, bool assign,
+                               bool &inserted) {
+            if (node == nullptr) {
+                inserted = true;
+                return createNode(key, value, nullptr, nullptr);
+            }
+
+            if (compare(key, node->value.first)) {
+                const Node *left = insertInto(node->left, key, value, assign, inserted);
+                return left == node->left ? node : join(node, left, node->right);
+            }
+
+            if (compare(node->value.first, key)) {
+                const Node *right = insertInto(node->right, key, value, assign, inserted);
+                return right == node->right ? node : join(node, node->left, right);
+            }
+
+            if (!assign) return node;
+
+            retired.push_back(node);
+            return createNode(node->value.first, value, node->left, node->right);
+        }
+
+        const Node *removeFrom(const Node *node, const key_type &key, bool &removed) {
+            if (node == nullptr) return nullptr;
+
+            if (compare(key, node->value.first)) {
+                const Node *left = removeFrom(node->left, key, removed);
+                return removed ? join(node, left, node->right) : node;
+            }
+
+            if (compare(node->value.first, key)) {
+                const Node *right = removeFrom(node->right, key, removed);
+                return removed ? join(node, node->left, right) : node;
+            }
+
+            removed = true;
+            retired.push_back(node);
+
+            if (node->left == nullptr) return node->right;
+            if (node->right == nullptr) return node->left;
+
+            const Node *successor = nullptr;
+            const Node *right = removeMin(node->right, successor);
+            return join(successor, node->left, right);
+        }
+
+        const Node *removeMin(const Node *node, const Node *&min) {
+            if (node->left == nullptr) {
+                min = node;
+                return node->right;
+            }
+
+            const Node *left = removeMin(node->left, min);
+            return join(node, left, node->right);
+        }
+
+        void freeRetired() {
+            for (const Node *node : retired) delete node;
+            retired.clear();
+        }
+
+        void destroySubtree(const Node *node) {
+            if (node == nullptr) return;
+
+            destroySubtree(node->left);
+            destroySubtree(node->right);
+            delete node;
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Compare>
+    class ConcurrentTreeMap<KeyType, ValueType, Compare>::Node {
+    public:
+        const value_type value;
+        const Node *const left;
+        const Node *const right;
+        const int height;
+
+        Node(const key_type &key, const mapped_type &mapped, const Node *left, const Node *right)
+                : value(key, mapped), left(left), right(right),
+                  height(1 + (ConcurrentTreeMap::height(left) > ConcurrentTreeMap::height(right)
+                              ? ConcurrentTreeMap::height(left) : ConcurrentTreeMap::height(right))) {}
+    };
+
+    // Pins the root current at construction; everything reached through it
+    // stays valid, and unchanged, until the snapshot is destroyed. Hold it
+    // briefly: writers wait for it before they can free anything, which also
+    // means a thread must not write to the map while it holds one.
+    template<typename KeyType, typename ValueType, typename Compare>
+    class ConcurrentTreeMap<KeyType, ValueType, Compare>::Snapshot {
+    public:
+        const ConcurrentTreeMap *map;
+        std::atomic<long> *counter;
+        const Node *root;
+
+        explicit Snapshot(const ConcurrentTreeMap *map): map(map) {
+            counter = &map->readers[map->parity.load()][readerStripe()].active;
+            counter->fetch_add(1);
+            root = map->root.load();
+        }
+
+        Snapshot(Snapshot &&other): map(other.map), counter(other.counter), root(other.root) {
+            other.counter = nullptr;
+        }
+
+        Snapshot(const Snapshot &) = delete;
+
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        ~Snapshot() {
+            if (counter != nullptr) counter->fetch_sub(1);
+        }
+
+        const Node *lookup(const key_type &key) const {
+            const Node *temp = root;
+
+            while (temp != nullptr) {
+                if (map->compare(temp->value.first, key)) {
+                    temp = temp->right;
+                } else if (map->compare(key, temp->value.first)) {
+                    temp = temp->left;
+                } else {
+                    return temp;
+                }
+            }
+
+            return nullptr;
+        }
+
+        const_iterator find(const key_type &key) const {
+            const_iterator it;
+            const Node *temp = root;
+
+            // the stack has to hold every ancestor the walk went left from
+            while (temp != nullptr) {
+                if (map->compare(temp->value.first, key)) {
+                    temp = temp->right;
+                } else {
+                    it.path.push_back(temp);
+
+                    if (!map->compare(key, temp->value.first)) return it;
+
+                    temp = temp->left;
+                }
+            }
+
+            return end();
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            const Node *node = lookup(key);
+
+            if (node == nullptr) throw std::out_of_range("");
+
+            return node->value.second;
+        }
+
+        bool contains(const key_type &key) const {
+            return lookup(key) != nullptr;
+        }
+
+        // First element whose key is not less than key.
+        const_iterator lower_bound(const key_type &key) const {
+            const_iterator it;
+            const Node *temp = root;
+
+            while (temp != nullptr) {
+                if (map->compare(temp->value.first, key)) {
+                    temp = temp->right;
+                } else {
+                    it.path.push_back(temp);
+                    temp = temp->left;
+                }
+            }
+
+            return it;
+        }
+
+        const_iterator begin() const {
+            const_iterator it;
+            it.pushLeft(root);
+            return it;
+        }
+
+        const_iterator end() const {
+            return const_iterator();
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+    };
+
+    // Nodes have no parent links (they are shared between versions), so the
+    // iterator keeps the path of pending ancestors itself. Forward only.
+    template<typename KeyType, typename ValueType, typename Compare>
+    class ConcurrentTreeMap<KeyType, ValueType, Compare>::ConstIterator {
+    public:
+        using reference = typename ConcurrentTreeMap::const_reference;
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename ConcurrentTreeMap::value_type;
+        using pointer = const typename ConcurrentTreeMap::value_type *;
+        using difference_type = std::ptrdiff_t;
+
+        std::vector<const Node *> path;
+
+        void pushLeft(const Node *node) {
+            for (; node != nullptr; node = node->left) path.push_back(node);
+        }
+
+        ConstIterator &operator++() {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (path.empty()) throw std::out_of_range("");
+#endif
+
+            const Node *node = path.back();
+            path.pop_back();
+            pushLeft(node->right);
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator it(*this);
+            this->operator++();
+            return it;
+        }
+
+        reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (path.empty()) throw std::out_of_range("");
+#endif
+
+            return path.back()->value;
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        bool operator==(const ConstIterator &other) const {
+            if (path.empty() || other.path.empty()) return path.empty() == other.path.empty();
+
+            return path.back() == other.path.back();
+        }
+
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_CONCURRENTTREEMAP_H */
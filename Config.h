@@ -0,0 +1,32 @@
+#ifndef AISDI_MAPS_CONFIG_H
+#define AISDI_MAPS_CONFIG_H
+
+// Starts pulling the cache line at address in without waiting for it; a hint
+// only, so it compiles to nothing where the compiler has no such builtin.
+#if defined(__GNUC__) || defined(__clang__)
+#define AISDI_MAPS_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define AISDI_MAPS_PREFETCH(address) ((void) 0)
+#endif
+
+// With checked iterators, stepping an iterator past either end or
+// dereferencing end() throws std::out_of_range. Without them that is undefined,
+// as for the standard containers, and the iterators do no work beyond the step
+// itself. Checks are on unless NDEBUG is defined; define this to 0 or 1 before
+// including any map to choose explicitly.
+#ifndef AISDI_MAPS_CHECKED_ITERATORS
+#if defined(NDEBUG)
+#define AISDI_MAPS_CHECKED_ITERATORS 0
+#else
+#define AISDI_MAPS_CHECKED_ITERATORS 1
+#endif
+#endif
+
+// With stats on, HashMap and TreeMap count lookups, probes, node allocations,
+// rehashes and rotations and report them through stats() (see MapStats.h).
+// Off by default; off, the maps carry no counters and do no extra work.
+#ifndef AISDI_MAPS_ENABLE_STATS
+#define AISDI_MAPS_ENABLE_STATS 0
+#endif
+
+#endif /* AISDI_MAPS_CONFIG_H */
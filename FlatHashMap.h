@@ -0,0 +1,787 @@
+#ifndef AISDI_MAPS_FLATHASHMAP_H
+#define AISDI_MAPS_FLATHASHMAP_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "Config.h"
+#include "TransparentLookup.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define AISDI_MAPS_SSE2 1
+#endif
+
+namespace aisdi {
+
+    // Open-addressing counterpart of HashMap with the same interface. Elements
+    // live inline in one contiguous slot array and are placed with Robin Hood
+    // linear probing. A parallel metadata array keeps, per slot, the probe
+    // distance + 1 in the low byte (0 marks an empty slot), so lookups mostly
+    // touch metadata and stop as soon as they pass the position the key would
+    // have been shifted to. For keys that are costly to compare it also keeps
+    // 8 bits of the element's hash in a high byte, and only keys whose tag
+    // matches are compared. Integers, enums and pointers under std::equal_to
+    // compare as cheaply as a tag, so they go without and keep the metadata
+    // at a byte per slot.
+    //
+    // With SSE2 a lookup matches a group of 16 bytes of metadata at once, 16
+    // slots without tags or 8 with: the elements from one home slot sit
+    // together, the i-th of them at distance i + 1, so one compare against
+    // (tag, 1..16) finds every candidate in the group.
+    //
+    // Inserting or removing shifts neighbouring elements, so any of them
+    // invalidates iterators and references (unlike HashMap). A new element is
+    // built before its cluster is touched; if moving a neighbour throws
+    // midway, the shifted part is pulled back, and an element whose own move
+    // then throws as well is dropped rather than left unreachable.
+    namespace detail {
+
+        // Keys whose equality is one compare of a machine word.
+        template<typename Key, typename KeyEqual>
+        struct IsTriviallyComparable
+                : std::integral_constant<bool, (std::is_integral<Key>::value || std::is_enum<Key>::value ||
+                                                std::is_pointer<Key>::value) &&
+                                               std::is_same<KeyEqual, std::equal_to<Key>>::value> {};
+
+    }
+
+    template<typename KeyType, typename ValueType,
+            typename Hash = std::hash<KeyType>, typename KeyEqual = std::equal_to<KeyType>>
+    class FlatHashMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+
+        class ConstIterator;
+
+        class Iterator;
+
+        using iterator = Iterator;
+        using const_iterator = ConstIterator;
+
+        static const size_type INITIAL_CAPACITY = 16;
+        static const std::uint8_t MAX_DISTANCE = 255;
+        static const bool TAGGED = !detail::IsTriviallyComparable<KeyType, KeyEqual>::value;
+
+        // probe distance + 1 in the low byte, the tag (if any) in the high one
+        using Metadata = typename std::conditional<TAGGED, std::uint16_t, std::uint8_t>::type;
+
+        static const size_type GROUP_WIDTH = 16 / sizeof(Metadata);
+
+        value_type *slots;
+        Metadata *metadata;
+        size_type capacity;
+        size_type elementCount;
+        unsigned shift;
+        float maxLoad;
+        Hash hashFunction;
+        KeyEqual keyEqual;
+
+        FlatHashMap(): FlatHashMap(Hash(), KeyEqual()) {}
+
+        FlatHashMap(const Hash &hash, const KeyEqual &equal)
+                : slots(nullptr), metadata(nullptr), capacity(0), elementCount(0), shift(0), maxLoad(0.8f),
+                  hashFunction(hash), keyEqual(equal) {
+            allocate(INITIAL_CAPACITY);
+        }
+
+        ~FlatHashMap() {
+            destroyAll();
+            deallocate();
+        }
+
+        FlatHashMap(std::initializer_list<value_type> list): FlatHashMap() {
+            reserve(list.size());
+
+            for (auto it = list.begin(); it != list.end(); ++it) {
+                insert_or_assign(it->first, it->second);
+            }
+        }
+
+        void swapMap(FlatHashMap &a, FlatHashMap &b) {
+            std::swap(a.slots, b.slots);
+            std::swap(a.metadata, b.metadata);
+            std::swap(a.capacity, b.capacity);
+            std::swap(a.elementCount, b.elementCount);
+            std::swap(a.shift, b.shift);
+            std::swap(a.maxLoad, b.maxLoad);
+            std::swap(a.hashFunction, b.hashFunction);
+            std::swap(a.keyEqual, b.keyEqual);
+        }
+
+        FlatHashMap(const FlatHashMap &other): FlatHashMap(other.hashFunction, other.keyEqual) {
+            maxLoad = other.maxLoad;
+            reserve(other.elementCount);
+
+            for (auto it = other.begin(); it != other.end(); ++it) {
+                try_emplace(it->first, it->second);
+            }
+        }
+
+        FlatHashMap(FlatHashMap &&other): FlatHashMap() {
+            swapMap(*this, other);
+        }
+
+        FlatHashMap &operator=(FlatHashMap other) {
+            swapMap(*this, other);
+            return *this;
+        }
+
+        bool isEmpty() const {
+            return elementCount == 0;
+        }
+
+        mapped_type &operator[](const key_type &key) {
+            return try_emplace(key).first->second;
+        }
+
+        mapped_type &operator[](key_type &&key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        // Builds the element from args only when key is missing; on a hit
+        // neither key nor args are touched.
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+            return emplaceUnique(key, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+            return emplaceUnique(std::move(key), std::forward<Args>(args)...);
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+            auto result = emplaceUnique(key, std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+            auto result = emplaceUnique(std::move(key), std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        // The key is only known once the element is built, so this constructs
+        // it aside and moves it into its slot on a miss.
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args &&... args) {
+            value_type element(std::forward<Args>(args)...);
+            size_type index = findIndex(element.first);
+            if (index != capacity) return std::make_pair(Iterator(ConstIterator(this, index)), false);
+
+            if (elementCount + 1 > capacity * maxLoad) rehash(capacity * 2);
+
+            index = insertNew(std::move(element));
+            return std::make_pair(Iterator(ConstIterator(this, index)), true);
+        }
+
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceUnique(K &&key, Args &&... args) {
+            size_type index = findIndex(key);
+            if (index != capacity) return std::make_pair(Iterator(ConstIterator(this, index)), false);
+
+            value_type element(std::piecewise_construct,
+                               std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+
+            if (elementCount + 1 > capacity * maxLoad) rehash(capacity * 2);
+
+            index = insertNew(std::move(element));
+            return std::make_pair(Iterator(ConstIterator(this, index)), true);
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            return slotOf(key).second;
+        }
+
+        mapped_type &valueOf(const key_type &key) {
+            return slotOf(key).second;
+        }
+
+        const_iterator find(const key_type &key) const {
+            return ConstIterator(this, findIndex(key));
+        }
+
+        iterator find(const key_type &key) {
+            return Iterator(ConstIterator(this, findIndex(key)));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        const mapped_type &valueOf(const K &key) const {
+            return slotOf(key).second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        mapped_type &valueOf(const K &key) {
+            return slotOf(key).second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        const_iterator find(const K &key) const {
+            return ConstIterator(this, findIndex(key));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        iterator find(const K &key) {
+            return Iterator(ConstIterator(this, findIndex(key)));
+        }
+
+        bool contains(const key_type &key) const {
+            return findIndex(key) != capacity;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        bool contains(const K &key) const {
+            return findIndex(key) != capacity;
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        size_type count(const K &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        void remove(const key_type &key) {
+            remove(find(key));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        void remove(const K &key) {
+            remove(find(key));
+        }
+
+        void remove(const const_iterator &it) {
+            if (it.map != this || it.index >= capacity || distanceAt(it.index) == 0) throw std::out_of_range("");
+
+            slots[it.index].~value_type();
+            metadata[it.index] = 0;
+            --elementCount;
+
+            closeGap(it.index);
+        }
+
+        size_type getSize() const {
+            return elementCount;
+        }
+
+        // Drops every element but keeps the slot array for reuse.
+        void clear() {
+            destroyAll();
+
+            for (size_type i = 0; i < capacity; ++i) {
+                metadata[i] = 0;
+            }
+
+            elementCount = 0;
+        }
+
+        size_type getBucketCount() const {
+            return capacity;
+        }
+
+        float getLoadFactor() const {
+            return (float) elementCount / capacity;
+        }
+
+        float getMaxLoadFactor() const {
+            return maxLoad;
+        }
+
+        void setMaxLoadFactor(float factor) {
+            if (!(factor > 0.0f && factor <= 1.0f)) throw std::out_of_range("");
+
+            maxLoad = factor;
+            if (elementCount > capacity * maxLoad) rehash(0);
+        }
+
+        // Moves every element into a table of at least n slots (rounded up to a
+        // power of two), never going below what the max load factor requires.
+        void rehash(size_type n) {
+            size_type required = (size_type) std::ceil(elementCount / maxLoad);
+            if (n < required) n = required;
+
+            size_type newCapacity = INITIAL_CAPACITY;
+            while (newCapacity < n) newCapacity *= 2;
+            if (newCapacity == capacity) return;
+
+            value_type *oldSlots = slots;
+            Metadata *oldMetadata = metadata;
+            size_type oldCapacity = capacity;
+            size_type oldCount = elementCount;
+            unsigned oldShift = shift;
+
+            allocate(newCapacity);
+            elementCount = 0;
+
+            // Elements whose move may throw are copied, so until the old table
+            // is dropped it can always be put back as it was.
+            size_type i = 0;
+            bool overflow = false;
+            try {
+                for (; i < oldCapacity && !overflow; ++i) {
+                    if ((std::uint8_t) oldMetadata[i] == 0) continue;
+
+                    overflow = placeNew(mixedHash(oldSlots[i].first), std::move_if_noexcept(oldSlots[i])) == capacity;
+                }
+            }
+            catch (...) {
+                restore(oldSlots, oldMetadata, oldCapacity, oldShift, oldCount, i);
+                throw;
+            }
+
+            if (overflow) {
+                restore(oldSlots, oldMetadata, oldCapacity, oldShift, oldCount, i);
+
+                // a sparse table that still overflows means the hash collides
+                // on far more than MAX_DISTANCE keys; growing will not help
+                if (elementCount * 8 < newCapacity) throw std::length_error("");
+
+                rehash(newCapacity * 2);
+                return;
+            }
+
+            for (i = 0; i < oldCapacity; ++i) {
+                if ((std::uint8_t) oldMetadata[i] != 0) oldSlots[i].~value_type();
+            }
+
+            std::allocator<value_type>().deallocate(oldSlots, oldCapacity);
+            delete [] oldMetadata;
+        }
+
+        void reserve(size_type n) {
+            size_type required = (size_type) std::ceil(n / maxLoad);
+            if (required > capacity) rehash(required);
+        }
+
+        bool operator==(const FlatHashMap &other) const {
+            if (elementCount != other.elementCount) return false;
+
+            for (auto it = cbegin(); it != cend(); ++it) {
+                auto it2 = other.find(it->first);
+                if (it2 == other.cend() || it->second != it2->second) return false;
+            }
+
+            return true;
+        }
+
+        bool operator!=(const FlatHashMap &other) const {
+            return !operator==(other);
+        }
+
+        iterator begin() {
+            return Iterator(cbegin());
+        }
+
+        iterator end() {
+            return Iterator(cend());
+        }
+
+        const_iterator cbegin() const {
+            return ConstIterator(this, findOccupied(0));
+        }
+
+        const_iterator cend() const {
+            return ConstIterator(this, capacity);
+        }
+
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        const_iterator end() const {
+            return cend();
+        }
+
+        template<typename K>
+        std::uint64_t mixedHash(const K &key) const {
+            // Fibonacci hashing spreads weak hashes (std::hash<int> is the identity)
+            // over the upper bits before they are used as a power-of-two index
+            return (std::uint64_t) hashFunction(key) * 0x9E3779B97F4A7C15ull;
+        }
+
+        size_type homeIndex(std::uint64_t mixed) const {
+            return (size_type) (mixed >> shift);
+        }
+
+        // The 8 bits right below the index bits, which elements sharing a home
+        // slot are least likely to have in common, moved into the high byte.
+        Metadata tagOf(std::uint64_t mixed) const {
+            if (!TAGGED) return 0;
+
+            return (Metadata) (((shift >= 8 ? mixed >> (shift - 8) : mixed) & 0xFF) << 8);
+        }
+
+        std::uint8_t distanceAt(size_type index) const {
+            return (std::uint8_t) metadata[index];
+        }
+
+        // Like findIndex, but a missing key is an error whether or not
+        // iterators are checked.
+        template<typename K>
+        value_type &slotOf(const K &key) const {
+            size_type index = findIndex(key);
+
+            if (index == capacity) throw std::out_of_range("");
+
+            return slots[index];
+        }
+
+        template<typename K>
+        size_type findIndex(const K &key) const {
+            std::uint64_t mixed = mixedHash(key);
+            size_type index = homeIndex(mixed);
+            Metadata tag = tagOf(mixed);
+            std::uint8_t distance = 1;
+
+#ifdef AISDI_MAPS_SSE2
+            if (index + GROUP_WIDTH <= capacity) {
+                // the slot to compare is only known once the metadata is matched;
+                // start fetching the likeliest one, the home slot, right away
+                _mm_prefetch(reinterpret_cast<const char *>(&slots[index]), _MM_HINT_T0);
+
+                // only elements from this home slot can sit i slots past it at
+                // distance i + 1, so no stop position is needed to rule out the rest
+                unsigned match = matchGroup(metadata + index, tag);
+
+                for (; match != 0; match &= match - 1) {
+                    size_type candidate = index + __builtin_ctz(match) / sizeof(Metadata);
+                    if (keyEqual(slots[candidate].first, key)) return candidate;
+                }
+
+                // the probe only goes on if the group's last slot is still part of it
+                if (distanceAt(index + GROUP_WIDTH - 1) < GROUP_WIDTH) return capacity;
+
+                index = (index + GROUP_WIDTH) & (capacity - 1);
+                distance = GROUP_WIDTH + 1;
+            }
+#endif
+
+            for (; distance <= distanceAt(index); ++distance) {
+                if (metadata[index] == (tag | distance) && keyEqual(slots[index].first, key)) return index;
+
+                index = (index + 1) & (capacity - 1);
+            }
+
+            return capacity;
+        }
+
+#ifdef AISDI_MAPS_SSE2
+        // One bit per byte of the group, set on the low byte of every slot
+        // holding (tag, i + 1) i slots in.
+        static unsigned matchGroup(const std::uint16_t *group, std::uint16_t tag) {
+            const __m128i expected = _mm_or_si128(_mm_setr_epi16(1, 2, 3, 4, 5, 6, 7, 8), _mm_set1_epi16((short) tag));
+            __m128i metadata = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+
+            return _mm_movemask_epi8(_mm_cmpeq_epi16(metadata, expected)) & 0x5555u;
+        }
+
+        static unsigned matchGroup(const std::uint8_t *group, std::uint8_t) {
+            const __m128i expected = _mm_setr_epi8(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+            __m128i metadata = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(metadata, expected));
+        }
+#endif
+
+        size_type findOccupied(size_type index) const {
+            while (index < capacity && distanceAt(index) == 0) ++index;
+
+            return index;
+        }
+
+    private:
+        void allocate(size_type newCapacity) {
+            slots = std::allocator<value_type>().allocate(newCapacity);
+            metadata = new Metadata[newCapacity]();
+            capacity = newCapacity;
+
+            shift = 64;
+            for (size_type c = newCapacity; c > 1; c /= 2) --shift;
+        }
+
+        void deallocate() {
+            std::allocator<value_type>().deallocate(slots, capacity);
+            delete [] metadata;
+        }
+
+        void destroyAll() {
+            for (size_type i = 0; i < capacity; ++i) {
+                if (distanceAt(i) != 0) slots[i].~value_type();
+            }
+        }
+
+        // Moves in an element whose key is known to be absent and returns its
+        // slot, growing the table when the cluster would overflow. Capacity
+        // must already allow one more element.
+        size_type insertNew(value_type &&element) {
+            std::uint64_t mixed = mixedHash(element.first);
+
+            for (;;) {
+                size_type index = placeNew(mixed, std::move(element));
+                if (index != capacity) return index;
+
+                // a sparse table that still overflows means the hash collides
+                // on far more than MAX_DISTANCE keys; growing will not help
+                if (elementCount * 8 < capacity) throw std::length_error("");
+
+                rehash(capacity * 2);
+            }
+        }
+
+        // Robin Hood placement of an element that is not in the table yet.
+        // Returns capacity, touching nothing, when some element of the cluster
+        // would go past MAX_DISTANCE. If a move throws, the cluster is put
+        // back together before the exception leaves.
+        template<typename V>
+        size_type placeNew(std::uint64_t mixed, V &&element) {
+            size_type index = homeIndex(mixed);
+            std::uint8_t distance = 1;
+
+            // first slot that is empty or holds an element closer to its home
+            while (distanceAt(index) >= distance) {
+                index = (index + 1) & (capacity - 1);
+                ++distance;
+            }
+
+            size_type last = index;
+            bool overflow = distance == MAX_DISTANCE;
+            while (distanceAt(last) != 0) {
+                if (distanceAt(last) == MAX_DISTANCE - 1) overflow = true;
+                last = (last + 1) & (capacity - 1);
+            }
+
+            if (overflow) return capacity;
+
+            // shift the rest of the cluster right by one to open the slot; the
+            // slot being filled is always marked empty, so a throw leaves a
+            // plain gap for closeGap
+            try {
+                while (last != index) {
+                    size_type prev = (last - 1) & (capacity - 1);
+                    new (&slots[last]) value_type(std::move(slots[prev]));
+                    metadata[last] = metadata[prev] + 1;
+                    slots[prev].~value_type();
+                    metadata[prev] = 0;
+                    last = prev;
+                }
+
+                new (&slots[index]) value_type(std::forward<V>(element));
+            }
+            catch (...) {
+                closeGap(last);
+                throw;
+            }
+
+            metadata[index] = tagOf(mixed) | distance;
+            ++elementCount;
+
+            return index;
+        }
+
+        // Backward shift into the empty slot gap: pulls the rest of its
+        // cluster one slot closer to home. An element whose move throws is
+        // dropped, and the gap it leaves closed first, so the table stays
+        // searchable whatever happens.
+        void closeGap(size_type gap) {
+            for (size_type next = (gap + 1) & (capacity - 1); distanceAt(next) > 1;
+                 next = (gap + 1) & (capacity - 1)) {
+                try {
+                    new (&slots[gap]) value_type(std::move(slots[next]));
+                    metadata[gap] = metadata[next] - 1;
+                    slots[next].~value_type();
+                    metadata[next] = 0;
+                    gap = next;
+                }
+                catch (...) {
+                    slots[next].~value_type();
+                    metadata[next] = 0;
+                    --elementCount;
+                    closeGap(next);
+                }
+            }
+        }
+
+        // Undoes a rehash that stopped after the first processed old slots:
+        // elements that were moved (not copied) go back where they came from.
+        void restore(value_type *oldSlots, Metadata *oldMetadata, size_type oldCapacity, unsigned oldShift,
+                     size_type oldCount, size_type processed) {
+            if (std::is_nothrow_move_constructible<value_type>::value) {
+                for (size_type i = 0; i < processed; ++i) {
+                    if ((std::uint8_t) oldMetadata[i] == 0) continue;
+
+                    size_type index = findIndex(oldSlots[i].first);
+                    if (index == capacity) continue;
+
+                    oldSlots[i].~value_type();
+                    new (&oldSlots[i]) value_type(std::move(slots[index]));
+                }
+            }
+
+            destroyAll();
+            deallocate();
+
+            slots = oldSlots;
+            metadata = oldMetadata;
+            capacity = oldCapacity;
+            shift = oldShift;
+            elementCount = oldCount;
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+    class FlatHashMap<KeyType, ValueType, Hash, KeyEqual>::ConstIterator {
+    public:
+        using reference = typename FlatHashMap::const_reference;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename FlatHashMap::value_type;
+        using pointer = const typename FlatHashMap::value_type *;
+
+        const FlatHashMap *map;
+        size_type index;
+
+        explicit ConstIterator() {
+            map = nullptr;
+            index = 0;
+        }
+
+        ConstIterator(const FlatHashMap *map, size_type index) {
+            this->map = map;
+            this->index = index;
+        }
+
+        ConstIterator(const ConstIterator &other) {
+            map = other.map;
+            index = other.index;
+        }
+
+        ConstIterator &operator++() {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (index >= map->capacity) throw std::out_of_range("");
+#endif
+
+            index = map->findOccupied(index + 1);
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator it(*this);
+            this->operator++();
+            return it;
+        }
+
+        ConstIterator &operator--() {
+            size_type prev = index;
+
+            while (prev > 0) {
+                --prev;
+                if (map->distanceAt(prev) != 0) {
+                    index = prev;
+                    return *this;
+                }
+            }
+
+#if AISDI_MAPS_CHECKED_ITERATORS
+            throw std::out_of_range("");
+#endif
+            return *this;
+        }
+
+        ConstIterator operator--(int) {
+            ConstIterator it(*this);
+            this->operator--();
+            return it;
+        }
+
+        reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (index >= map->capacity) throw std::out_of_range("");
+#endif
+
+            return map->slots[index];
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        bool operator==(const ConstIterator &other) const {
+            return map == other.map && index == other.index;
+        }
+
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+    class FlatHashMap<KeyType, ValueType, Hash, KeyEqual>::Iterator
+            : public FlatHashMap<KeyType, ValueType, Hash, KeyEqual>::ConstIterator {
+    public:
+        using reference = typename FlatHashMap::reference;
+        using pointer = typename FlatHashMap::value_type *;
+
+        explicit Iterator() {}
+
+        Iterator(const ConstIterator &other)
+                : ConstIterator(other) {}
+
+        Iterator &operator++() {
+            ConstIterator::operator++();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto result = *this;
+            ConstIterator::operator++();
+            return result;
+        }
+
+        Iterator &operator--() {
+            ConstIterator::operator--();
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            auto result = *this;
+            ConstIterator::operator--();
+            return result;
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        reference operator*() const {
+            // ugly cast, yet reduces code duplication.
+            return const_cast<reference>(ConstIterator::operator*());
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_FLATHASHMAP_H */
@@ -0,0 +1,519 @@
+#ifndef AISDI_MAPS_FROZEN_MAP_H
+#define AISDI_MAPS_FROZEN_MAP_H
+
+// Immutable, read-optimized copies of a HashMap or TreeMap for tables that
+// stop changing after warmup:
+//
+//   auto table = aisdi::freeze(hashMap);     // FrozenHashMap
+//   auto index = aisdi::freeze(treeMap);     // FrozenTreeMap
+//
+// Both keep all elements in one contiguous array and never allocate after
+// construction. No member function modifies any state, so one frozen map can
+// be read from any number of threads without synchronization.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Config.h"
+#include "HashMap.h"
+#include "Hashing.h"
+#include "TreeMap.h"
+
+namespace aisdi {
+
+    namespace detail {
+
+        // x scaled into [0, n) by a multiply, cheaper than x % n.
+        inline std::uint64_t reduceRange(std::uint64_t x, std::uint64_t n) {
+#if defined(__SIZEOF_INT128__)
+            return (std::uint64_t) (((__uint128_t) x * n) >> 64);
+#else
+            return x % n;
+#endif
+        }
+
+    }
+
+    // Minimal perfect hash table (hash and displace, as in CHD and PTHash).
+    // Keys fall into about n / 4 buckets; each bucket stores a pilot chosen
+    // at construction so that every key of the bucket gets a slot of its own.
+    // Buckets are placed largest first, while the table is still empty. The
+    // table has 1% spare slots so the last buckets find a free one quickly;
+    // keys that land past n are moved into the free slots below n through a
+    // small remap array. A lookup is one hash, one pilot, one key comparison.
+    template<typename KeyType, typename ValueType, typename Hash = FastHash<KeyType>,
+            typename KeyEqual = std::equal_to<KeyType>>
+    class FrozenHashMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+        using const_iterator = typename std::vector<value_type>::const_iterator;
+        using iterator = const_iterator;
+
+        static const std::uint32_t MAX_PILOT = 1u << 24;
+
+        std::vector<value_type> entries;
+        std::vector<std::uint32_t> pilots;
+        std::vector<std::uint32_t> remap;
+        // Only used when keys share a full hash value, which no pilot can
+        // separate: linear probing over entry index plus one, 0 for empty.
+        std::vector<std::uint32_t> probe;
+        std::uint64_t tableSize;
+        Hash hashFunction;
+        KeyEqual keyEqual;
+
+        // Copies the elements of [first, last), which must have distinct keys.
+        template<typename ForwardIt>
+        FrozenHashMap(ForwardIt first, ForwardIt last, const Hash &hash = Hash(), const KeyEqual &equal = KeyEqual())
+                : tableSize(0), hashFunction(hash), keyEqual(equal) {
+            std::vector<const value_type *> elements;
+            for (; first != last; ++first) elements.push_back(&*first);
+            if (elements.size() >= 0xFFFFFFFFu) throw std::length_error("");
+
+            std::vector<std::uint64_t> hashes(elements.size());
+            for (size_type i = 0; i < elements.size(); ++i) hashes[i] = hashOf(elements[i]->first);
+
+            std::vector<std::uint32_t> order;
+            if (!placeKeys(hashes, order)) placeProbed(hashes, order);
+
+            entries.reserve(elements.size());
+            for (std::uint32_t index : order) entries.emplace_back(*elements[index]);
+        }
+
+        bool isEmpty() const {
+            return entries.empty();
+        }
+
+        size_type getSize() const {
+            return entries.size();
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            const_iterator it = find(key);
+            if (it == end()) throw std::out_of_range("");
+
+            return it->second;
+        }
+
+        const_iterator find(const key_type &key) const {
+            if (entries.empty()) return end();
+
+            std::uint64_t hash = hashOf(key);
+
+            if (!probe.empty()) {
+                std::uint64_t mask = probe.size() - 1;
+                for (std::uint64_t slot = hash & mask; probe[slot] != 0; slot = (slot + 1) & mask) {
+                    if (keyEqual(entries[probe[slot] - 1].first, key)) return entries.begin() + (probe[slot] - 1);
+                }
+                return end();
+            }
+
+            std::uint64_t slot = slotOf(hash, pilots[bucketOf(hash)]);
+            if (slot >= entries.size()) slot = remap[slot - entries.size()];
+
+            return keyEqual(entries[slot].first, key) ? entries.begin() + slot : end();
+        }
+
+        bool contains(const key_type &key) const {
+            return find(key) != end();
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        const_iterator begin() const {
+            return entries.begin();
+        }
+
+        const_iterator end() const {
+            return entries.end();
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+
+        std::uint64_t hashOf(const key_type &key) const {
+            std::uint64_t hash = (std::uint64_t) hashFunction(key);
+            return detail::IsAvalanching<Hash>::value ? hash : detail::mix64(hash);
+        }
+
+        // the bucket comes from the high bits of the hash, the slot from the
+        // whole hash remixed with the pilot
+        std::uint64_t bucketOf(std::uint64_t hash) const {
+            return detail::reduceRange(hash, pilots.size());
+        }
+
+        std::uint64_t slotOf(std::uint64_t hash, std::uint32_t pilot) const {
+            return detail::reduceRange(detail::mix64(hash ^ (pilot * 0x9E3779B97F4A7C15ull)), tableSize);
+        }
+
+        // Chooses the pilots and fills order with the element index of every
+        // slot; false if some bucket cannot be placed.
+        bool placeKeys(const std::vector<std::uint64_t> &hashes, std::vector<std::uint32_t> &order) {
+            std::uint64_t n = hashes.size();
+            if (n == 0) return true;
+
+            pilots.assign((size_type) (n + 3) / 4, 0);
+            tableSize = n + n / 100 + 1;
+
+            // counting sort of the elements by bucket
+            std::vector<std::uint32_t> bucketStart(pilots.size() + 1, 0);
+            for (std::uint64_t hash : hashes) ++bucketStart[bucketOf(hash) + 1];
+            for (size_type b = 0; b < pilots.size(); ++b) bucketStart[b + 1] += bucketStart[b];
+
+            std::vector<std::uint32_t> members((size_type) n);
+            std::vector<std::uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+            for (std::uint32_t i = 0; i < n; ++i) members[fill[bucketOf(hashes[i])]++] = i;
+
+            // and of the buckets by size, largest first
+            std::uint32_t largest = 0;
+            for (size_type b = 0; b < pilots.size(); ++b) {
+                std::uint32_t begin = bucketStart[b], end = bucketStart[b + 1];
+                largest = std::max(largest, end - begin);
+
+                // equal hashes share a bucket and every slot, give up early
+                for (std::uint32_t i = begin; i < end; ++i) {
+                    for (std::uint32_t j = i + 1; j < end; ++j) {
+                        if (hashes[members[i]] == hashes[members[j]]) {
+                            pilots.clear();
+                            tableSize = 0;
+                            return false;
+                        }
+                    }
+                }
+            }
+
+            std::vector<std::uint32_t> bySize;
+            bySize.reserve(pilots.size());
+            for (std::uint32_t size = largest; size > 0; --size) {
+                for (size_type b = 0; b < pilots.size(); ++b) {
+                    if (bucketStart[b + 1] - bucketStart[b] == size) bySize.push_back((std::uint32_t) b);
+                }
+            }
+
+            std::vector<std::uint32_t> owner((size_type) tableSize, 0xFFFFFFFFu);
+            std::vector<std::uint64_t> slots(largest);
+
+            for (std::uint32_t b : bySize) {
+                std::uint32_t begin = bucketStart[b], size = bucketStart[b + 1] - begin;
+                std::uint32_t pilot = 0;
+
+                for (; pilot < MAX_PILOT; ++pilot) {
+                    std::uint32_t placed = 0;
+                    for (; placed < size; ++placed) {
+                        std::uint64_t slot = slotOf(hashes[members[begin + placed]], pilot);
+                        if (owner[(size_type) slot] != 0xFFFFFFFFu) break;
+
+                        owner[(size_type) slot] = members[begin + placed];
+                        slots[placed] = slot;
+                    }
+                    if (placed == size) break;
+
+                    // collided with an earlier bucket or with itself
+                    while (placed-- > 0) owner[(size_type) slots[placed]] = 0xFFFFFFFFu;
+                }
+
+                if (pilot == MAX_PILOT) {
+                    pilots.clear();
+                    tableSize = 0;
+                    return false;
+                }
+                pilots[b] = pilot;
+            }
+
+            // slots past n are remapped into the free slots below n, of
+            // which there are exactly as many as taken slots past n
+            order.assign((size_type) n, 0);
+            remap.assign((size_type) (tableSize - n), 0);
+
+            std::uint64_t freeSlot = 0;
+            for (std::uint64_t slot = 0; slot < tableSize; ++slot) {
+                if (owner[(size_type) slot] == 0xFFFFFFFFu) continue;
+                if (slot < n) {
+                    order[(size_type) slot] = owner[(size_type) slot];
+                    continue;
+                }
+                while (owner[(size_type) freeSlot] != 0xFFFFFFFFu) ++freeSlot;
+                owner[(size_type) freeSlot] = owner[(size_type) slot];
+                order[(size_type) freeSlot] = owner[(size_type) slot];
+                remap[(size_type) (slot - n)] = (std::uint32_t) freeSlot;
+            }
+
+            return true;
+        }
+
+        void placeProbed(const std::vector<std::uint64_t> &hashes, std::vector<std::uint32_t> &order) {
+            size_type size = 2;
+            while (size < 2 * hashes.size()) size *= 2;
+            probe.assign(size, 0);
+
+            order.resize(hashes.size());
+            for (std::uint32_t i = 0; i < hashes.size(); ++i) {
+                order[i] = i;
+
+                std::uint64_t slot = hashes[i] & (size - 1);
+                while (probe[(size_type) slot] != 0) slot = (slot + 1) & (size - 1);
+                probe[(size_type) slot] = i + 1;
+            }
+        }
+    };
+
+    // Sorted array in Eytzinger (breadth-first) order: the root at index 1,
+    // the children of k at 2k and 2k + 1. A search touches the top levels on
+    // the same few cache lines every time and walks down with no branch to
+    // mispredict, prefetching four levels ahead. Iteration runs in key order
+    // by stepping to the in-order successor in the implicit tree.
+    template<typename KeyType, typename ValueType, typename Compare = std::less<KeyType>>
+    class FrozenTreeMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+
+        class ConstIterator;
+
+        using const_iterator = ConstIterator;
+        using iterator = ConstIterator;
+
+        // entries[k - 1] holds Eytzinger index k
+        std::vector<value_type> entries;
+        Compare compare;
+
+        // Copies the elements of [first, last), whose keys must be strictly
+        // increasing by Compare; throws std::invalid_argument otherwise.
+        template<typename ForwardIt>
+        FrozenTreeMap(ForwardIt first, ForwardIt last, const Compare &compare = Compare())
+                : compare(compare) {
+            std::vector<const value_type *> sorted;
+            for (; first != last; ++first) {
+                if (!sorted.empty() && !compare(sorted.back()->first, first->first)) throw std::invalid_argument("");
+
+                sorted.push_back(&*first);
+            }
+
+            std::vector<const value_type *> layout(sorted.size() + 1);
+            size_type next = 0;
+            placeInOrder(1, sorted, layout, next);
+
+            entries.reserve(sorted.size());
+            for (size_type k = 1; k <= sorted.size(); ++k) entries.emplace_back(*layout[k]);
+        }
+
+        bool isEmpty() const {
+            return entries.empty();
+        }
+
+        size_type getSize() const {
+            return entries.size();
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            const_iterator it = find(key);
+            if (it == end()) throw std::out_of_range("");
+
+            return it->second;
+        }
+
+        const_iterator find(const key_type &key) const {
+            size_type k = lowerBoundIndex(key);
+            return k != 0 && !compare(key, entry(k).first) ? ConstIterator(this, k) : end();
+        }
+
+        bool contains(const key_type &key) const {
+            return find(key) != end();
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        // First element whose key is not less than key.
+        const_iterator lower_bound(const key_type &key) const {
+            return ConstIterator(this, lowerBoundIndex(key));
+        }
+
+        // First element whose key is greater than key.
+        const_iterator upper_bound(const key_type &key) const {
+            size_type n = entries.size(), k = 1;
+
+            while (k <= n) {
+                AISDI_MAPS_PREFETCH(entries.data() + std::min(16 * k, n) - 1);
+                k = 2 * k + (compare(key, entry(k).first) ? 0 : 1);
+            }
+
+            return ConstIterator(this, lastLeftTurn(k));
+        }
+
+        const_iterator begin() const {
+            size_type k = 1;
+            while (2 * k <= entries.size()) k *= 2;
+
+            return ConstIterator(this, entries.empty() ? 0 : k);
+        }
+
+        const_iterator end() const {
+            return ConstIterator(this, 0);
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+
+        const value_type &entry(size_type k) const {
+            return entries[k - 1];
+        }
+
+        // Eytzinger index of the first key not less than key, 0 if none. The
+        // descent goes right past smaller keys and left otherwise, so the
+        // answer is the node of its last left turn.
+        size_type lowerBoundIndex(const key_type &key) const {
+            size_type n = entries.size(), k = 1;
+
+            while (k <= n) {
+                AISDI_MAPS_PREFETCH(entries.data() + std::min(16 * k, n) - 1);
+                k = 2 * k + (compare(entry(k).first, key) ? 1 : 0);
+            }
+
+            return lastLeftTurn(k);
+        }
+
+        // Drops the trailing right turns and the left turn before them.
+        static size_type lastLeftTurn(size_type k) {
+            while (k & 1) k >>= 1;
+            return k >> 1;
+        }
+
+        void placeInOrder(size_type k, const std::vector<const value_type *> &sorted,
+                          std::vector<const value_type *> &layout, size_type &next) {
+            if (k > sorted.size()) return;
+
+            placeInOrder(2 * k, sorted, layout, next);
+            layout[k] = sorted[next++];
+            placeInOrder(2 * k + 1, sorted, layout, next);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Compare>
+    class FrozenTreeMap<KeyType, ValueType, Compare>::ConstIterator {
+    public:
+        using reference = typename FrozenTreeMap::value_type const &;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename FrozenTreeMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const typename FrozenTreeMap::value_type *;
+
+        const FrozenTreeMap *map;
+        // Eytzinger index, 0 for end()
+        size_type index;
+
+        ConstIterator(): map(nullptr), index(0) {}
+
+        ConstIterator(const FrozenTreeMap *map, size_type index): map(map), index(index) {}
+
+        // in-order successor: the leftmost node of the right subtree, or
+        // else the ancestor whose left subtree this is
+        ConstIterator &operator++() {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (index == 0) throw std::out_of_range("");
+#endif
+
+            size_type n = map->entries.size();
+            if (2 * index + 1 <= n) {
+                index = 2 * index + 1;
+                while (2 * index <= n) index *= 2;
+            } else {
+                index = lastLeftTurn(index);
+            }
+
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator result(*this);
+            ++*this;
+            return result;
+        }
+
+        ConstIterator &operator--() {
+            size_type n = map->entries.size();
+
+            if (index == 0) {
+#if AISDI_MAPS_CHECKED_ITERATORS
+                if (n == 0) throw std::out_of_range("");
+#endif
+                index = 1;
+                while (2 * index + 1 <= n) index = 2 * index + 1;
+            } else if (2 * index <= n) {
+                index = 2 * index;
+                while (2 * index + 1 <= n) index = 2 * index + 1;
+            } else {
+                // up to the ancestor whose right subtree this is
+                while (index != 0 && (index & 1) == 0) index >>= 1;
+#if AISDI_MAPS_CHECKED_ITERATORS
+                if (index <= 1) throw std::out_of_range("");
+#endif
+                index >>= 1;
+            }
+
+            return *this;
+        }
+
+        ConstIterator operator--(int) {
+            ConstIterator result(*this);
+            --*this;
+            return result;
+        }
+
+        reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (index == 0) throw std::out_of_range("");
+#endif
+
+            return map->entry(index);
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        bool operator==(const ConstIterator &other) const {
+            return map == other.map && index == other.index;
+        }
+
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+    FrozenHashMap<KeyType, ValueType, Hash, KeyEqual> freeze(const HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator> &map) {
+        return FrozenHashMap<KeyType, ValueType, Hash, KeyEqual>(map.cbegin(), map.cend(), map.hashFunction, map.keyEqual);
+    }
+
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    FrozenTreeMap<KeyType, ValueType, Compare> freeze(const TreeMap<KeyType, ValueType, Compare, Allocator> &map) {
+        return FrozenTreeMap<KeyType, ValueType, Compare>(map.cbegin(), map.cend(), map.compare);
+    }
+
+}
+
+#endif /* AISDI_MAPS_FROZEN_MAP_H */
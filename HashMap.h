@@ -1,15 +1,36 @@
 #ifndef AISDI_MAPS_HASHMAP_H
 #define AISDI_MAPS_HASHMAP_H
 
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <initializer_list>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <list>
+#include <vector>
+
+#include "Config.h"
+#include "Hashing.h"
+#include "MapStats.h"
+#include "PoolAllocator.h"
+#include "TransparentLookup.h"
 
 namespace aisdi {
 
-    template<typename KeyType, typename ValueType>
+    // The bucket count is always a power of two and the bucket index is the
+    // low bits of the hash. Hashers that do not declare is_avalanching (see
+    // Hashing.h) are run through a mixer first, so std::hash works as well.
+    // An empty map owns no bucket table until its first insertion, so
+    // building, moving and destroying empty maps allocates nothing.
+    template<typename KeyType, typename ValueType,
+            typename Hash = FastHash<KeyType>, typename KeyEqual = std::equal_to<KeyType>,
+            typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
     class HashMap {
     public:
         using key_type = KeyType;
@@ -18,6 +39,9 @@ namespace aisdi {
         using size_type = std::size_t;
         using reference = value_type &;
         using const_reference = const value_type &;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+        using allocator_type = Allocator;
 
         class ConstIterator;
 
@@ -25,51 +49,75 @@ namespace aisdi {
 
         class BucketNode;
 
-        static const int BUCKETS = 10;
+        using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<BucketNode>;
+        using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+        static const size_type INITIAL_BUCKETS = 16;
+        static const size_type BATCH_SIZE = 16;
 
         BucketNode ** buckets;
-        int *sizes;
+        size_type bucketCount;
+        // lowest non-empty bucket, bucketCount when empty; keeps begin() O(1)
+        size_type firstBucket;
+        size_type elementCount;
+        float maxLoad;
+        Hash hashFunction;
+        KeyEqual keyEqual;
+        NodeAllocator nodeAllocator;
+#if AISDI_MAPS_ENABLE_STATS
+        mutable detail::StatsRecorder statsRecorder;
+#endif
 
         using iterator = Iterator;
         using const_iterator = ConstIterator;
 
-        HashMap() {
-            sizes = new int[BUCKETS]();
-            buckets = new BucketNode*[BUCKETS]();
-        }
+        HashMap(): HashMap(Hash(), KeyEqual(), Allocator()) {}
 
-        ~HashMap(){
-                for (int i = 0; i < BUCKETS; ++i) {
-                    BucketNode *temp = buckets[i];
-                    BucketNode *temp2;
+        explicit HashMap(const Allocator &allocator): HashMap(Hash(), KeyEqual(), allocator) {}
 
-                    if (!buckets[i]) continue;
+        HashMap(const Hash &hash, const KeyEqual &equal, const Allocator &allocator = Allocator())
+                : buckets(emptyBuckets()), bucketCount(1), firstBucket(1), elementCount(0), maxLoad(1.0f),
+                  hashFunction(hash), keyEqual(equal), nodeAllocator(allocator) {}
 
-                    while (temp != nullptr) {
-                        temp2 = temp->next;
-                        delete temp;
-                        temp = temp2;
-                    }
-                }
+        ~HashMap(){
+                destroyNodes();
+
+                if (buckets != emptyBuckets()) delete [] buckets;
+        }
 
-                delete [] buckets;
-                delete [] sizes;
+        // The one-bucket table every map starts with. It is shared and never
+        // written; the first insertion replaces it with INITIAL_BUCKETS.
+        static BucketNode **emptyBuckets() {
+            static BucketNode *empty[1] = {nullptr};
+            return empty;
         }
 
         HashMap(std::initializer_list<value_type> list): HashMap() {
                 for (auto it = list.begin(); it != list.end(); ++it) {
-                    this->operator[](it->first) = it->second;
+                    insert_or_assign(it->first, it->second);
                 }
         }
 
-        void swapMap(HashMap<KeyType, ValueType> &a, HashMap<KeyType, ValueType> &b) {
+        void swapMap(HashMap &a, HashMap &b) {
             std::swap(a.buckets, b.buckets);
-            std::swap(a.sizes, b.sizes);
-        }
+            std::swap(a.bucketCount, b.bucketCount);
+            std::swap(a.firstBucket, b.firstBucket);
+            std::swap(a.elementCount, b.elementCount);
+            std::swap(a.maxLoad, b.maxLoad);
+            std::swap(a.hashFunction, b.hashFunction);
+            std::swap(a.keyEqual, b.keyEqual);
+            std::swap(a.nodeAllocator, b.nodeAllocator);
+            AISDI_MAPS_STAT(a.statsRecorder.swap(b.statsRecorder));
+        }
+
+        HashMap(const HashMap &other)
+                : HashMap(other.hashFunction, other.keyEqual,
+                          Allocator(NodeTraits::select_on_container_copy_construction(other.nodeAllocator))) {
+            maxLoad = other.maxLoad;
+            reserve(other.elementCount);
 
-        HashMap(const HashMap &other): HashMap() {
             for (auto it = other.begin(); it != other.end(); ++it){
-                this->operator[](it->first) = it->second;
+                try_emplace(it->first, it->second);
             }
         }
 
@@ -88,99 +136,431 @@ namespace aisdi {
 
 
         mapped_type &operator[](const key_type &key) {
-            int index = bucketHash(key);
+            return try_emplace(key).first->second;
+        }
+
+        mapped_type &operator[](key_type &&key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        // Builds the element from args only when key is missing; on a hit
+        // neither key nor args are touched.
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+            return emplaceUnique(key, std::forward<Args>(args)...);
+        }
 
-            BucketNode * node = new BucketNode();
-            delete node->val;
-            node->val = new value_type(key, ValueType{});
-            node->next = nullptr;
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+            return emplaceUnique(std::move(key), std::forward<Args>(args)...);
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+            auto result = emplaceUnique(key, std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
 
-            if (!buckets[index]){
-                buckets[index] = node;
-                node->prev = nullptr;
-                ++sizes[index];
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+            auto result = emplaceUnique(std::move(key), std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        // The key is only known once the element is built, so unlike
+        // try_emplace this constructs a node up front and drops it on a hit.
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args &&... args) {
+            if (buckets == emptyBuckets()) rehash(INITIAL_BUCKETS);
+
+            BucketNode *node = createNode(std::forward<Args>(args)...);
+            size_type index = bucketHash(node->val.first);
+            AISDI_MAPS_STAT(std::uint64_t probes = 0);
+
+            for (BucketNode *temp = buckets[index]; temp != nullptr; temp = temp->next){
+                AISDI_MAPS_STAT(++probes);
+                if (keyEqual(temp->val.first, node->val.first)){
+                    AISDI_MAPS_STAT(statsRecorder.chainSearch(probes, probes));
+                    destroyNode(node);
+                    return std::make_pair(Iterator(ConstIterator(this, index, temp)), false);
+                }
             }
-            else {
-                BucketNode * temp = buckets[index];
-                BucketNode * temp2 = temp;
 
-                while (temp != nullptr){
+            AISDI_MAPS_STAT(statsRecorder.chainSearch(probes, probes + 1));
+            return std::make_pair(linkNode(index, node), true);
+        }
 
-                    if (temp->val->first == key){
-                        delete node;
-                        return temp->val->second;
-                    }
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceUnique(K &&key, Args &&... args) {
+            return emplaceInBucket(bucketHash(key), std::forward<K>(key), std::forward<Args>(args)...);
+        }
 
-                    temp2 = temp;
-                    temp = temp->next;
+        // index must be the bucket of key.
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceInBucket(size_type index, K &&key, Args &&... args) {
+            AISDI_MAPS_STAT(std::uint64_t probes = 0);
+
+            for (BucketNode *temp = buckets[index]; temp != nullptr; temp = temp->next){
+                AISDI_MAPS_STAT(++probes);
+                if (keyEqual(temp->val.first, key)) {
+                    AISDI_MAPS_STAT(statsRecorder.chainSearch(probes, probes));
+                    return std::make_pair(Iterator(ConstIterator(this, index, temp)), false);
                 }
+            }
+
+            AISDI_MAPS_STAT(statsRecorder.chainSearch(probes, probes + 1));
+
+            if (buckets == emptyBuckets()) {
+                rehash(INITIAL_BUCKETS);
+                index = bucketHash(key);
+            }
 
-                temp2->next = node;
-                node->prev = temp2;
-                ++sizes[index];
+            BucketNode *node = createNode(std::piecewise_construct,
+                                          std::forward_as_tuple(std::forward<K>(key)),
+                                          std::forward_as_tuple(std::forward<Args>(args)...));
+
+            return std::make_pair(linkNode(index, node), true);
+        }
+
+        // Puts a node at the front of its chain and grows the table if needed.
+        iterator linkNode(size_type index, BucketNode *node) {
+            node->prev = nullptr;
+            node->next = buckets[index];
+            if (buckets[index]) buckets[index]->prev = node;
+            buckets[index] = node;
+            if (index < firstBucket) firstBucket = index;
+
+            ++elementCount;
+            if (elementCount > bucketCount * maxLoad) {
+                rehash(bucketCount * 2);
+                index = bucketHash(node->val.first);
             }
 
-            return node->val->second;
+            return Iterator(ConstIterator(this, index, node));
+        }
+
+        template<typename K>
+        size_type bucketHash(const K &key) const {
+            return bucketIndex(hashFunction(key), bucketCount);
+        }
+
+        static size_type bucketIndex(std::size_t hash, size_type buckets) {
+            std::uint64_t mixed = detail::IsAvalanching<Hash>::value ? hash : detail::mix64(hash);
+            return (size_type) mixed & (buckets - 1);
         }
 
-        int bucketHash(const key_type &key) const {
-            return (int)std::hash<key_type >{}(key) % BUCKETS;
+        size_type getBucketCount() const {
+            return bucketCount;
+        }
+
+        float getLoadFactor() const {
+            return (float) elementCount / bucketCount;
+        }
+
+        float getMaxLoadFactor() const {
+            return maxLoad;
+        }
+
+        void setMaxLoadFactor(float factor) {
+            if (!(factor > 0.0f)) throw std::out_of_range("");
+
+            maxLoad = factor;
+            if (elementCount > bucketCount * maxLoad) rehash(0);
+        }
+
+        // Relinks every node into a table of at least n buckets (rounded up
+        // to a power of two), never going below what the current size and max
+        // load factor require.
+        void rehash(size_type n) {
+            size_type required = (size_type) std::ceil(elementCount / maxLoad);
+            if (n < required) n = required;
+
+            size_type rounded = 1;
+            while (rounded < n) rounded *= 2;
+            n = rounded;
+            if (n == bucketCount) return;
+
+            BucketNode **newBuckets = new BucketNode*[n]();
+            size_type newFirst = n;
+
+            for (size_type i = 0; i < bucketCount; ++i) {
+                BucketNode *node = buckets[i];
+
+                while (node != nullptr) {
+                    BucketNode *next = node->next;
+                    size_type index = bucketIndex(hashFunction(node->val.first), n);
+
+                    node->prev = nullptr;
+                    node->next = newBuckets[index];
+                    if (newBuckets[index]) newBuckets[index]->prev = node;
+                    newBuckets[index] = node;
+                    if (index < newFirst) newFirst = index;
+
+                    node = next;
+                }
+            }
+
+            if (buckets != emptyBuckets()) delete [] buckets;
+            buckets = newBuckets;
+            bucketCount = n;
+            firstBucket = newFirst;
+            AISDI_MAPS_STAT(statsRecorder.rehash());
+        }
+
+        void reserve(size_type n) {
+            size_type required = (size_type) std::ceil(n / maxLoad);
+            if (required > bucketCount) rehash(required);
+        }
+
+        // Snapshot of how evenly the hasher spreads the current keys.
+        struct BucketStats {
+            size_type bucketCount;
+            size_type elementCount;
+            size_type usedBuckets;
+            size_type maxChainLength;
+            // chainLengths[k] buckets hold exactly k elements
+            std::vector<size_type> chainLengths;
+            float loadFactor;
+            // share of elements that landed in an already occupied bucket;
+            // 0 is a perfect spread, 1 - 1 / n means everything in one chain
+            float collisionRate;
+        };
+
+        // Counters of the work done since construction or resetStats(); all
+        // zero unless built with AISDI_MAPS_ENABLE_STATS. bucketStats() gives
+        // the exact chain lengths at this moment instead.
+        MapStats stats() const {
+#if AISDI_MAPS_ENABLE_STATS
+            return statsRecorder.snapshot();
+#else
+            return MapStats();
+#endif
+        }
+
+        void resetStats() {
+            AISDI_MAPS_STAT(statsRecorder.reset());
+        }
+
+        // A no-op unless built with AISDI_MAPS_ENABLE_STATS.
+        void setStatsCallback(StatsCallback callback) {
+#if AISDI_MAPS_ENABLE_STATS
+            statsRecorder.callback = std::move(callback);
+#else
+            (void) callback;
+#endif
+        }
+
+        // Walks every chain once, O(buckets + elements).
+        BucketStats bucketStats() const {
+            BucketStats stats;
+            stats.bucketCount = bucketCount;
+            stats.elementCount = elementCount;
+            stats.usedBuckets = 0;
+            stats.maxChainLength = 0;
+            stats.chainLengths.assign(1, 0);
+
+            for (size_type i = 0; i < bucketCount; ++i) {
+                size_type chain = 0;
+                for (BucketNode *node = buckets[i]; node != nullptr; node = node->next) ++chain;
+
+                if (chain >= stats.chainLengths.size()) stats.chainLengths.resize(chain + 1, 0);
+                ++stats.chainLengths[chain];
+
+                if (chain > 0) ++stats.usedBuckets;
+                if (chain > stats.maxChainLength) stats.maxChainLength = chain;
+            }
+
+            stats.loadFactor = getLoadFactor();
+            stats.collisionRate = elementCount == 0
+                                  ? 0.0f : (float) (elementCount - stats.usedBuckets) / elementCount;
+            return stats;
         }
 
         const mapped_type &valueOf(const key_type &key) const {
-            return find(key)->second;
+            return findNode(key)->val.second;
         }
 
         mapped_type &valueOf(const key_type &key) {
-            return find(key)->second;
+            return findNode(key)->val.second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        const mapped_type &valueOf(const K &key) const {
+            return findNode(key)->val.second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        mapped_type &valueOf(const K &key) {
+            return findNode(key)->val.second;
         }
 
         const_iterator find(const key_type &key) const {
-            int index = bucketHash(key);
+            return lookup(key);
+        }
 
-            if (!buckets[index]) return cend();
+        iterator find(const key_type &key) {
+            return Iterator(lookup(key));
+        }
 
-            BucketNode *node = buckets[index];
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        const_iterator find(const K &key) const {
+            return lookup(key);
+        }
 
-            for (int i = 0; i < sizes[index]; ++i){
-                if (node->val->first == key) return ConstIterator(this, index, node);
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        iterator find(const K &key) {
+            return Iterator(lookup(key));
+        }
 
-                node = node->next;
+        bool contains(const key_type &key) const {
+            return lookup(key).node != nullptr;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        bool contains(const K &key) const {
+            return lookup(key).node != nullptr;
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        size_type count(const K &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        // Shared by the key_type and heterogeneous overloads; K is only ever
+        // something other than key_type when Hash and KeyEqual are transparent.
+        template<typename K>
+        const_iterator lookup(const K &key) const {
+            return lookupInBucket(bucketHash(key), key);
+        }
+
+        // Like lookup, but a missing key is an error whether or not iterators
+        // are checked.
+        template<typename K>
+        BucketNode *findNode(const K &key) const {
+            BucketNode *node = lookup(key).node;
+
+            if (node == nullptr) throw std::out_of_range("");
+
+            return node;
+        }
+
+        template<typename K>
+        const_iterator lookupInBucket(size_type index, const K &key) const {
+            AISDI_MAPS_STAT(std::uint64_t probes = 0);
+
+            for (BucketNode *node = buckets[index]; node != nullptr; node = node->next){
+                AISDI_MAPS_STAT(++probes);
+                if (keyEqual(node->val.first, key)) {
+                    AISDI_MAPS_STAT(statsRecorder.chainSearch(probes, probes));
+                    return ConstIterator(this, index, node);
+                }
             }
 
+            AISDI_MAPS_STAT(statsRecorder.chainSearch(probes, probes));
             return cend();
         }
 
-        iterator find(const key_type &key) {
-            int index = bucketHash(key);
+        // Batch counterparts of find and try_emplace for many keys at once.
+        // Keys go through in groups of BATCH_SIZE: the whole group is hashed
+        // and its bucket slots prefetched, then the chain heads, and only then
+        // are the chains walked, so the cache misses of one group overlap
+        // instead of being paid one key after another.
 
-            if (!buckets[index]) return end();
+        template<typename KeyRange, typename Visit>
+        void forEachFound(const KeyRange &keys, Visit visit) const {
+            size_type indices[BATCH_SIZE];
+            auto it = std::begin(keys);
+            auto last = std::end(keys);
 
-            BucketNode *node = buckets[index];
+            while (it != last) {
+                auto batch = it;
+                size_type count = 0;
 
-            for (int i = 0; i < sizes[index]; ++i){
-                if (buckets[index][i].val->first == key) return Iterator(ConstIterator(this, index, node));
+                for (; count < BATCH_SIZE && it != last; ++count, ++it) {
+                    indices[count] = bucketHash(*it);
+                    AISDI_MAPS_PREFETCH(&buckets[indices[count]]);
+                }
 
-                node = node->next;
+                for (size_type i = 0; i < count; ++i) {
+                    AISDI_MAPS_PREFETCH(buckets[indices[i]]);
+                }
+
+                for (size_type i = 0; i < count; ++i, ++batch) {
+                    visit(lookupInBucket(indices[i], *batch));
+                }
             }
+        }
+
+        // Writes one iterator per key in keys (a forward range of key_type) to
+        // out, end() for a missing key; returns the advanced out.
+        template<typename KeyRange, typename OutputIt>
+        OutputIt findMany(const KeyRange &keys, OutputIt out) const {
+            forEachFound(keys, [&out](const const_iterator &it) { *out++ = it; });
+            return out;
+        }
 
-            return end();
+        template<typename KeyRange, typename OutputIt>
+        OutputIt findMany(const KeyRange &keys, OutputIt out) {
+            forEachFound(keys, [&out](const const_iterator &it) { *out++ = Iterator(it); });
+            return out;
         }
 
-        BucketNode * findNext(int listIndex) const {
-            for (int i = listIndex; i < BUCKETS; ++i){
+        // Adds every element of elements (a forward range of key/value pairs)
+        // whose key is missing, like try_emplace; returns how many were added.
+        template<typename Range>
+        size_type insertMany(const Range &elements) {
+            std::size_t hashes[BATCH_SIZE];
+            size_type inserted = 0;
+            auto it = std::begin(elements);
+            auto last = std::end(elements);
+
+            // grow once up front rather than in the middle of a batch
+            reserve(elementCount + (size_type) std::distance(it, last));
+
+            while (it != last) {
+                auto batch = it;
+                size_type count = 0;
+
+                for (; count < BATCH_SIZE && it != last; ++count, ++it) {
+                    hashes[count] = hashFunction(it->first);
+                    AISDI_MAPS_PREFETCH(&buckets[bucketIndex(hashes[count], bucketCount)]);
+                }
+
+                for (size_type i = 0; i < count; ++i) {
+                    AISDI_MAPS_PREFETCH(buckets[bucketIndex(hashes[i], bucketCount)]);
+                }
+
+                for (size_type i = 0; i < count; ++i, ++batch) {
+                    if (emplaceInBucket(bucketIndex(hashes[i], bucketCount), batch->first, batch->second).second)
+                        ++inserted;
+                }
+            }
+
+            return inserted;
+        }
+
+        BucketNode * findNext(size_type listIndex) const {
+            for (size_type i = listIndex; i < bucketCount; ++i){
                 if (buckets[i] != nullptr) return buckets[i];
             }
 
             return nullptr;
         }
 
-        BucketNode * findPrev(int listIndex) const {
-            for (int i = listIndex; i >= 0; --i){
+        BucketNode * findPrev(size_type listIndex) const {
+            for (size_type i = listIndex + 1; i-- > 0; ){
                 if (buckets[i] != nullptr) {
                     BucketNode*temp = buckets[i];
 
-                    for (int j = 0; j < sizes[i]; ++j){
+                    while (temp->next != nullptr){
                         temp = temp->next;
                     }
 
@@ -192,36 +572,31 @@ namespace aisdi {
         }
 
         BucketNode * findFirst() const{
-            for (int i = 0; i < BUCKETS; ++i){
-                if (buckets[i] != nullptr) return buckets[i];
-            }
-
-            return nullptr;
+            return firstBucket < bucketCount ? buckets[firstBucket] : nullptr;
         }
 
-        int findFirstListIndex() const{
-            for (int i = 0; i < BUCKETS; ++i){
-                if (buckets[i] != nullptr) return i;
-            }
-
-            return BUCKETS;
+        size_type findFirstListIndex() const{
+            return firstBucket;
         }
 
         void remove(const key_type &key) {
             remove(find(key));
         }
 
-        void remove(const const_iterator &it) {
-            int index = bucketHash(it->first);
-
-            if (!buckets[index]) throw std::out_of_range("");
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        void remove(const K &key) {
+            remove(find(key));
+        }
 
+        void remove(const const_iterator &it) {
             BucketNode *temp = it.node;
 
             if (temp == nullptr){
                 throw std::out_of_range("");
             }
 
+            size_type index = it.listIndex;
+
             if (temp->prev){
                 temp->prev->next = temp->next;
             }
@@ -234,34 +609,44 @@ namespace aisdi {
                 temp->next->prev = temp->prev;
             }
 
-            --sizes[index];
-            delete temp;
+            // moves forward only, so erasing from begin() to end() scans the
+            // table once overall
+            if (index == firstBucket) {
+                while (firstBucket < bucketCount && buckets[firstBucket] == nullptr) ++firstBucket;
+            }
+
+            --elementCount;
+            destroyNode(temp);
+        }
+
+        size_type getSize() const {
+            return elementCount;
         }
 
-        int getSize() const {
-            int size = 0;
-            for (int i = 0; i < BUCKETS; ++i){
-                size += sizes[i];
+        // Drops every element but keeps the bucket table for reuse.
+        void clear() {
+            destroyNodes();
+
+            if (buckets != emptyBuckets()) {
+                for (size_type i = 0; i < bucketCount; ++i) {
+                    buckets[i] = nullptr;
+                }
             }
 
-            return size;
+            firstBucket = bucketCount;
+            elementCount = 0;
         }
 
         bool operator==(const HashMap &other) const {
             if (getSize() != other.getSize()) return false;
-            else {
-
-                auto it = cbegin();
-                auto it2 = other.cbegin();
-
-                while (it != cend() && it2 != other.cend()) {
-                    if (it->first != it2->first || it->second != it2->second) return false;
-                    ++it;
-                    ++it2;
-                }
 
-                return it == cend() && it2 == other.cend();
+            // bucket layouts may differ after rehashing, so look every key up
+            for (auto it = cbegin(); it != cend(); ++it) {
+                auto it2 = other.find(it->first);
+                if (it2 == other.cend() || it->second != it2->second) return false;
             }
+
+            return true;
         }
 
         bool operator!=(const HashMap &other) const {
@@ -273,7 +658,7 @@ namespace aisdi {
         }
 
         iterator end() {
-            return Iterator(ConstIterator(this, BUCKETS, nullptr));
+            return Iterator(ConstIterator(this, bucketCount, nullptr));
         }
 
         const_iterator cbegin() const {
@@ -281,7 +666,7 @@ namespace aisdi {
         }
 
         const_iterator cend() const {
-            return ConstIterator(this, BUCKETS, nullptr);
+            return ConstIterator(this, bucketCount, nullptr);
         }
 
         const_iterator begin() const {
@@ -291,10 +676,62 @@ namespace aisdi {
         const_iterator end() const {
             return cend();
         }
+
+        allocator_type getAllocator() const {
+            return allocator_type(nodeAllocator);
+        }
+
+        template<typename... Args>
+        BucketNode *createNode(Args &&... args) {
+            BucketNode *node = NodeTraits::allocate(nodeAllocator, 1);
+
+            try {
+                NodeTraits::construct(nodeAllocator, node, std::forward<Args>(args)...);
+            }
+            catch (...) {
+                NodeTraits::deallocate(nodeAllocator, node, 1);
+                throw;
+            }
+
+            AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.nodeAllocations));
+            return node;
+        }
+
+        void destroyNode(BucketNode *node) {
+            NodeTraits::destroy(nodeAllocator, node);
+            NodeTraits::deallocate(nodeAllocator, node, 1);
+            AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.nodeFrees));
+        }
+
+        // Frees every node. An allocator that owns its pool alone gives it back
+        // in one shot, and then only values that need a destructor are visited.
+        void destroyNodes() {
+            bool bulk = detail::BulkRelease<NodeAllocator>::canRelease(nodeAllocator);
+
+            if (!bulk || !std::is_trivially_destructible<value_type>::value) {
+                for (size_type i = 0; i < bucketCount; ++i) {
+                    BucketNode *temp = buckets[i];
+
+                    while (temp != nullptr) {
+                        BucketNode *next = temp->next;
+
+                        if (bulk) NodeTraits::destroy(nodeAllocator, temp);
+                        else destroyNode(temp);
+
+                        temp = next;
+                    }
+                }
+            }
+
+            if (bulk) {
+                detail::BulkRelease<NodeAllocator>::release(nodeAllocator);
+                AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.nodeFrees, elementCount));
+            }
+        }
     };
 
-    template<typename KeyType, typename ValueType>
-    class HashMap<KeyType, ValueType>::ConstIterator {
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+    class HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::ConstIterator {
     public:
         using reference = typename HashMap::const_reference;
         using iterator_category = std::bidirectional_iterator_tag;
@@ -302,11 +739,12 @@ namespace aisdi {
         using pointer = const typename HashMap::value_type *;
 
         const HashMap *map;
-        int listIndex = 0;
+        size_type listIndex = 0;
         BucketNode * node;
 
         explicit ConstIterator() {
             map = nullptr;
+            node = nullptr;
         }
 
         ConstIterator(const ConstIterator &other) {
@@ -315,17 +753,19 @@ namespace aisdi {
             node = other.node;
         }
 
-        ConstIterator(const HashMap *map, int listInd, BucketNode * node) {
+        ConstIterator(const HashMap *map, size_type listInd, BucketNode * node) {
             this->map = map;
             this->listIndex = listInd;
             this->node = node;
         }
 
         ConstIterator &operator++() {
-            if (listIndex >= map->BUCKETS) throw std::out_of_range("");
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (listIndex >= map->bucketCount) throw std::out_of_range("");
+#endif
 
             if (!node->next){
-                for ( ++listIndex; listIndex < BUCKETS; ++listIndex){
+                for ( ++listIndex; listIndex < map->bucketCount; ++listIndex){
                     if (map->buckets[listIndex] != nullptr) {
                         node = map->buckets[listIndex];
                         return *this;
@@ -349,27 +789,32 @@ namespace aisdi {
             return it;
         }
 
+        // Walking back from end() to begin() visits every bucket once, like
+        // walking forward does.
         ConstIterator &operator--() {
-             if (this->node == map->findFirst()) throw std::out_of_range("");
-
-            if (!node || !node->prev){
-                for (--listIndex; listIndex >= 0; --listIndex){
-                    if (map->buckets[listIndex] != nullptr) {
-                        BucketNode*temp = map->buckets[listIndex];
+            if (node && node->prev){
+                node = node->prev;
+                return *this;
+            }
 
-                        while (temp->next != nullptr){
-                            temp = temp->next;
-                        }
+            for (size_type index = listIndex; index-- > 0; ){
+                if (map->buckets[index] != nullptr) {
+                    BucketNode*temp = map->buckets[index];
 
-                        node = temp;
-                        return *this;
+                    while (temp->next != nullptr){
+                        temp = temp->next;
                     }
+
+                    listIndex = index;
+                    node = temp;
+                    return *this;
                 }
             }
-            else {
-                node = node->prev;
-            }
 
+#if AISDI_MAPS_CHECKED_ITERATORS
+            // this was begin()
+            throw std::out_of_range("");
+#endif
             return *this;
         }
 
@@ -382,18 +827,19 @@ namespace aisdi {
         }
 
         reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
             if (!node) throw std::out_of_range("");
+#endif
 
-            return *(node->val);
+            return node->val;
         }
 
         pointer operator->() const {
             return &this->operator*();
         }
 
+        // A node is at one position only, and end() has no node.
         bool operator==(const ConstIterator &other) const {
-            if (listIndex != other.listIndex || map != other.map) return false;
-
             return node == other.node;
         }
 
@@ -402,8 +848,8 @@ namespace aisdi {
         }
     };
 
-    template<typename KeyType, typename ValueType>
-    class HashMap<KeyType, ValueType>::Iterator : public HashMap<KeyType, ValueType>::ConstIterator {
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+    class HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::Iterator : public HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::ConstIterator {
     public:
         using reference = typename HashMap::reference;
         using pointer = typename HashMap::value_type *;
@@ -445,24 +891,20 @@ namespace aisdi {
         }
     };
 
-    template <typename KeyType, typename ValueType>
-    class HashMap<KeyType, ValueType>::BucketNode{
+    template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+    class HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::BucketNode{
     public:
-        value_type * val;
+        value_type val;
 
         BucketNode * next;
         BucketNode * prev;
 
-        BucketNode(){
-            val = new value_type(KeyType{}, ValueType{});
+        template<typename... Args>
+        explicit BucketNode(Args &&... args): val(std::forward<Args>(args)...) {
             next = nullptr;
             prev = nullptr;
         }
 
-        ~BucketNode(){
-            delete val;
-        }
-
     };
 
 }
@@ -0,0 +1,54 @@
+#ifndef AISDI_MAPS_HASHING_H
+#define AISDI_MAPS_HASHING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#include "TransparentLookup.h"
+
+namespace aisdi {
+
+    namespace detail {
+
+        // Folded 64x64 -> 128 bit multiply (wyhash's "mum"): every input bit
+        // reaches the low output bits, which is what a power-of-two mask keeps.
+        inline std::uint64_t mix64(std::uint64_t x) {
+#if defined(__SIZEOF_INT128__)
+            __uint128_t product = (__uint128_t) x * 0x9E3779B97F4A7C15ull;
+            return (std::uint64_t) (product >> 64) ^ (std::uint64_t) product;
+#else
+            // xxh3's avalanche, for compilers without a 128-bit type
+            x ^= x >> 37;
+            x *= 0x165667919E3779F9ull;
+            return x ^ (x >> 32);
+#endif
+        }
+
+        // Hashers that promise well mixed output in every bit declare
+        // is_avalanching; the maps run anything else through mix64 first.
+        template<typename Hash, typename = void>
+        struct IsAvalanching : std::false_type {};
+
+        template<typename Hash>
+        struct IsAvalanching<Hash, VoidT<typename Hash::is_avalanching>> : std::true_type {};
+
+    }
+
+    // Default hasher of HashMap: std::hash for the key, finished with mix64.
+    // std::hash is the identity for integers on the common standard libraries,
+    // which leaves strided keys in a handful of buckets once the table index is
+    // taken from the low bits.
+    template<typename Key>
+    struct FastHash {
+        using is_avalanching = void;
+
+        std::size_t operator()(const Key &key) const {
+            return (std::size_t) detail::mix64((std::uint64_t) std::hash<Key>()(key));
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_HASHING_H */
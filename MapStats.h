@@ -0,0 +1,159 @@
+#ifndef AISDI_MAPS_MAPSTATS_H
+#define AISDI_MAPS_MAPSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+
+#include "Config.h"
+
+// Wraps statements that only exist in stats builds, so that with stats off
+// not even the local counters they update are left behind.
+#if AISDI_MAPS_ENABLE_STATS
+#define AISDI_MAPS_STAT(...) __VA_ARGS__
+#else
+#define AISDI_MAPS_STAT(...)
+#endif
+
+namespace aisdi {
+
+    // What a HashMap or TreeMap has done since it was built or last reset.
+    // Every field stays 0 unless AISDI_MAPS_ENABLE_STATS is 1 (see Config.h).
+    struct MapStats {
+        // finds, inserts and removals that searched for a key
+        std::uint64_t lookups = 0;
+        // nodes those searches visited: chain nodes for HashMap, tree nodes
+        // (one or two key comparisons each) for TreeMap
+        std::uint64_t probes = 0;
+        std::uint64_t nodeAllocations = 0;
+        std::uint64_t nodeFrees = 0;
+        // HashMap only
+        std::uint64_t rehashes = 0;
+        // TreeMap only
+        std::uint64_t rotations = 0;
+        // longest bucket chain a search walked, HashMap only
+        std::uint64_t maxChainLength = 0;
+        // deepest level a search reached, counting the root as 1; TreeMap only
+        std::uint64_t maxHeight = 0;
+    };
+
+    enum class StatsEvent {
+        Rehash,
+        MaxChainLength,
+        MaxHeight
+    };
+
+    // Called after each rehash and whenever maxChainLength or maxHeight grows,
+    // on the thread that caused it. The callback must not touch the map.
+    using StatsCallback = std::function<void(StatsEvent, const MapStats &)>;
+
+    namespace detail {
+
+        // The counters behind MapStats. They are relaxed atomics because const
+        // lookups count too, and ConcurrentHashMap runs those from many readers
+        // at once. A map that is copied starts from zero with no callback.
+        class StatsRecorder {
+        public:
+            using Counter = std::atomic<std::uint64_t>;
+
+            Counter lookups{0};
+            Counter probes{0};
+            Counter nodeAllocations{0};
+            Counter nodeFrees{0};
+            Counter rehashes{0};
+            Counter rotations{0};
+            Counter maxChainLength{0};
+            Counter maxHeight{0};
+            StatsCallback callback;
+
+            StatsRecorder() {}
+
+            StatsRecorder(const StatsRecorder &) {}
+
+            StatsRecorder &operator=(const StatsRecorder &) {
+                return *this;
+            }
+
+            static void add(Counter &counter, std::uint64_t n = 1) {
+                counter.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            // One search through a chain that visited probeCount nodes and
+            // saw the chain at least chainLength long.
+            void chainSearch(std::uint64_t probeCount, std::uint64_t chainLength) {
+                add(lookups);
+                add(probes, probeCount);
+                if (raise(maxChainLength, chainLength)) notify(StatsEvent::MaxChainLength);
+            }
+
+            // One descent that visited probeCount nodes and reached level depth.
+            void treeSearch(std::uint64_t probeCount, std::uint64_t depth) {
+                add(lookups);
+                add(probes, probeCount);
+                if (raise(maxHeight, depth)) notify(StatsEvent::MaxHeight);
+            }
+
+            void rehash() {
+                add(rehashes);
+                notify(StatsEvent::Rehash);
+            }
+
+            MapStats snapshot() const {
+                MapStats stats;
+                stats.lookups = lookups.load(std::memory_order_relaxed);
+                stats.probes = probes.load(std::memory_order_relaxed);
+                stats.nodeAllocations = nodeAllocations.load(std::memory_order_relaxed);
+                stats.nodeFrees = nodeFrees.load(std::memory_order_relaxed);
+                stats.rehashes = rehashes.load(std::memory_order_relaxed);
+                stats.rotations = rotations.load(std::memory_order_relaxed);
+                stats.maxChainLength = maxChainLength.load(std::memory_order_relaxed);
+                stats.maxHeight = maxHeight.load(std::memory_order_relaxed);
+                return stats;
+            }
+
+            void reset() {
+                for (Counter *counter : {&lookups, &probes, &nodeAllocations, &nodeFrees, &rehashes, &rotations,
+                                         &maxChainLength, &maxHeight}) {
+                    counter->store(0, std::memory_order_relaxed);
+                }
+            }
+
+            // Not atomic as a whole; only for swapMap, which no reader races.
+            void swap(StatsRecorder &other) {
+                Counter *mine[] = {&lookups, &probes, &nodeAllocations, &nodeFrees, &rehashes, &rotations,
+                                   &maxChainLength, &maxHeight};
+                Counter *theirs[] = {&other.lookups, &other.probes, &other.nodeAllocations, &other.nodeFrees,
+                                     &other.rehashes, &other.rotations, &other.maxChainLength, &other.maxHeight};
+
+                for (int i = 0; i < 8; ++i) {
+                    std::uint64_t value = mine[i]->load(std::memory_order_relaxed);
+                    mine[i]->store(theirs[i]->load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    theirs[i]->store(value, std::memory_order_relaxed);
+                }
+
+                std::swap(callback, other.callback);
+            }
+
+        private:
+            static bool raise(Counter &max, std::uint64_t value) {
+                std::uint64_t current = max.load(std::memory_order_relaxed);
+
+                while (value > current) {
+                    if (max.compare_exchange_weak(current, value, std::memory_order_relaxed)) return true;
+                }
+
+                return false;
+            }
+
+            void notify(StatsEvent event) const {
+                if (callback) callback(event, snapshot());
+            }
+        };
+
+    }
+
+}
+
+#endif /* AISDI_MAPS_MAPSTATS_H */
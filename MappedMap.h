@@ -0,0 +1,642 @@
+#ifndef AISDI_MAPS_MAPPED_MAP_H
+#define AISDI_MAPS_MAPPED_MAP_H
+
+// Snapshot files for maps of trivially copyable keys and values, and read-only
+// views that answer queries straight from the mapped file.
+//
+//   aisdi::save(tree, "tree.snap");
+//   aisdi::MappedTreeMap<int, Row> rows("tree.snap");   // mmap, no parsing
+//   auto copy = aisdi::load<aisdi::TreeMap<int, Row>>("tree.snap");
+//
+// A file is a header followed by an array of {first, second} entries, written
+// byte for byte in the layout of the machine that saved it: entries sorted by
+// key for a TreeMap, in table order plus an open addressing index for a
+// HashMap. Everything is addressed by offsets from the start of the file, so a
+// view is valid wherever the file gets mapped. Files are not portable between
+// platforms with a different endianness or type layout; the header records
+// the sizes it was written with and opening a mismatched file throws.
+//
+// save() replaces the file by renaming a complete new one over it, so views
+// of the old snapshot keep reading the old contents.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AISDI_MAPS_HAS_MMAP 1
+#endif
+
+#include "HashMap.h"
+#include "Hashing.h"
+#include "TreeMap.h"
+
+namespace aisdi {
+
+    // One stored element. Named like the members of value_type, so iterators
+    // of the mapped views read the same as those of the maps.
+    template<typename KeyType, typename ValueType>
+    struct SnapshotEntry {
+        KeyType first;
+        ValueType second;
+    };
+
+    namespace detail {
+
+        enum SnapshotLayout : std::uint32_t {
+            SORTED_SNAPSHOT = 1,
+            HASHED_SNAPSHOT = 2
+        };
+
+        struct SnapshotHeader {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t layout;
+            std::uint64_t keySize;
+            std::uint64_t valueSize;
+            std::uint64_t entrySize;
+            std::uint64_t count;
+            std::uint64_t entriesOffset;
+            // hashed layout only: slotCount 64-bit slots, each 0 for empty or
+            // the entry index plus one
+            std::uint64_t slotCount;
+            std::uint64_t slotsOffset;
+            std::uint64_t fileSize;
+        };
+
+        const char SNAPSHOT_MAGIC[8] = {'A', 'I', 'S', 'D', 'I', 'M', 'A', 'P'};
+        const std::uint32_t SNAPSHOT_VERSION = 1;
+        // entries start on a cache line; mmap hands out page aligned memory
+        const std::uint64_t SNAPSHOT_ALIGNMENT = 64;
+
+        inline std::uint64_t alignSnapshotOffset(std::uint64_t offset) {
+            return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+        }
+
+        template<typename KeyType, typename ValueType>
+        void checkSnapshotTypes() {
+            static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                          "snapshots store keys and values byte for byte");
+            static_assert(alignof(SnapshotEntry<KeyType, ValueType>) <= SNAPSHOT_ALIGNMENT,
+                          "entry alignment exceeds the snapshot alignment");
+        }
+
+        // Slot of a key in the hashed layout; the same rule writes and reads.
+        template<typename Hash, typename K>
+        std::uint64_t snapshotSlot(const Hash &hash, const K &key, std::uint64_t slotCount) {
+            return mix64((std::uint64_t) hash(key)) & (slotCount - 1);
+        }
+
+        // Read-only mapping of a whole file, unmapped on destruction. Without
+        // mmap the file is read into memory instead, so only the startup cost
+        // differs.
+        class MappedFile {
+        public:
+            const char *data;
+            std::size_t size;
+
+            explicit MappedFile(const std::string &path): data(nullptr), size(0) {
+#if defined(AISDI_MAPS_HAS_MMAP)
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) throw std::runtime_error("cannot open " + path);
+
+                struct stat info;
+                if (::fstat(fd, &info) != 0) {
+                    ::close(fd);
+                    throw std::runtime_error("cannot stat " + path);
+                }
+                size = (std::size_t) info.st_size;
+
+                if (size > 0) {
+                    void *address = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+                    if (address == MAP_FAILED) {
+                        ::close(fd);
+                        throw std::runtime_error("cannot map " + path);
+                    }
+                    data = static_cast<const char *>(address);
+                }
+                ::close(fd);
+#else
+                std::FILE *file = std::fopen(path.c_str(), "rb");
+                if (file == nullptr) throw std::runtime_error("cannot open " + path);
+
+                std::vector<char> contents;
+                char chunk[1 << 16];
+                std::size_t read;
+                while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0) contents.insert(contents.end(), chunk, chunk + read);
+                bool failed = std::ferror(file) != 0;
+                std::fclose(file);
+                if (failed) throw std::runtime_error("cannot read " + path);
+
+                size = contents.size();
+                char *copy = static_cast<char *>(::operator new(size + 1));
+                std::memcpy(copy, contents.data(), size);
+                data = copy;
+#endif
+            }
+
+            MappedFile(const MappedFile &) = delete;
+
+            MappedFile &operator=(const MappedFile &) = delete;
+
+            MappedFile(MappedFile &&other): data(other.data), size(other.size) {
+                other.data = nullptr;
+                other.size = 0;
+            }
+
+            MappedFile &operator=(MappedFile &&other) {
+                std::swap(data, other.data);
+                std::swap(size, other.size);
+                return *this;
+            }
+
+            ~MappedFile() {
+                if (data == nullptr) return;
+#if defined(AISDI_MAPS_HAS_MMAP)
+                ::munmap(const_cast<char *>(data), size);
+#else
+                ::operator delete(const_cast<char *>(data));
+#endif
+            }
+        };
+
+        // Maps path and checks that it is a snapshot of the given layout
+        // (0 accepts either) holding KeyType and ValueType.
+        template<typename KeyType, typename ValueType>
+        const SnapshotHeader &openSnapshot(const MappedFile &file, const std::string &path, std::uint32_t layout) {
+            using Entry = SnapshotEntry<KeyType, ValueType>;
+
+            if (file.size < sizeof(SnapshotHeader)) throw std::runtime_error(path + " is not a map snapshot");
+
+            const SnapshotHeader &header = *reinterpret_cast<const SnapshotHeader *>(file.data);
+
+            if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+                throw std::runtime_error(path + " is not a map snapshot");
+            if (header.version != SNAPSHOT_VERSION)
+                throw std::runtime_error(path + " has an unsupported snapshot version");
+            if (header.layout != SORTED_SNAPSHOT && header.layout != HASHED_SNAPSHOT)
+                throw std::runtime_error(path + " has an unsupported snapshot layout");
+            if (layout != 0 && header.layout != layout)
+                throw std::runtime_error(path + " has a different snapshot layout");
+            if (header.keySize != sizeof(KeyType) || header.valueSize != sizeof(ValueType) || header.entrySize != sizeof(Entry))
+                throw std::runtime_error(path + " holds different key or value types");
+
+            bool fits = header.fileSize == file.size
+                        && header.entriesOffset % SNAPSHOT_ALIGNMENT == 0
+                        && header.entriesOffset <= file.size
+                        && header.count <= (file.size - header.entriesOffset) / sizeof(Entry);
+            if (fits && header.layout == HASHED_SNAPSHOT) {
+                fits = header.slotCount > 0 && (header.slotCount & (header.slotCount - 1)) == 0
+                       && header.slotCount >= header.count
+                       && header.slotsOffset % SNAPSHOT_ALIGNMENT == 0
+                       && header.slotsOffset <= file.size
+                       && header.slotCount <= (file.size - header.slotsOffset) / sizeof(std::uint64_t);
+            }
+            if (!fits) throw std::runtime_error(path + " is truncated or corrupt");
+
+            return header;
+        }
+
+        // Buffered writer for one snapshot file; throws on the first failure.
+        // It writes a temporary file next to path and renames it over path in
+        // close(), so until the new snapshot is complete the old one, and any
+        // view still mapping it, stays intact. Destroying a writer that was
+        // not closed removes the temporary file.
+        class SnapshotWriter {
+        public:
+            std::FILE *file;
+            std::string path;
+            std::string tempPath;
+
+            explicit SnapshotWriter(const std::string &path): file(nullptr), path(path) {
+                static std::atomic<unsigned> counter(0);
+#if defined(AISDI_MAPS_HAS_MMAP)
+                // pid and counter keep concurrent writers apart; O_EXCL skips
+                // leftovers of a crashed one
+                for (;;) {
+                    tempPath = path + ".tmp" + std::to_string((long) ::getpid()) + "." + std::to_string(counter++);
+                    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+                    if (fd >= 0) {
+                        file = ::fdopen(fd, "wb");
+                        if (file == nullptr) {
+                            ::close(fd);
+                            ::unlink(tempPath.c_str());
+                        }
+                        break;
+                    }
+                    if (errno != EEXIST) break;
+                }
+#else
+                tempPath = path + ".tmp" + std::to_string(counter++);
+                file = std::fopen(tempPath.c_str(), "wb");
+#endif
+                if (file == nullptr) {
+                    tempPath.clear();
+                    throw std::runtime_error("cannot create " + path);
+                }
+            }
+
+            SnapshotWriter(const SnapshotWriter &) = delete;
+
+            SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+            ~SnapshotWriter() {
+                if (file != nullptr) std::fclose(file);
+                if (!tempPath.empty()) std::remove(tempPath.c_str());
+            }
+
+            void write(const void *data, std::size_t size) {
+                if (size > 0 && std::fwrite(data, 1, size, file) != size) throw std::runtime_error("cannot write " + path);
+            }
+
+            void pad(std::uint64_t offset) {
+                static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+                long position = std::ftell(file);
+                if (position < 0) throw std::runtime_error("cannot write " + path);
+                write(zeros, (std::size_t) (offset - (std::uint64_t) position));
+            }
+
+            void close() {
+                int result = std::fflush(file);
+#if defined(AISDI_MAPS_HAS_MMAP)
+                // on disk before the rename, or a crash could leave path empty
+                if (result == 0) result = ::fsync(::fileno(file));
+#endif
+                if (std::fclose(file) != 0) result = -1;
+                file = nullptr;
+                if (result != 0) throw std::runtime_error("cannot write " + path);
+
+                if (std::rename(tempPath.c_str(), path.c_str()) != 0) throw std::runtime_error("cannot replace " + path);
+                tempPath.clear();
+            }
+        };
+
+        inline SnapshotHeader makeSnapshotHeader(std::uint32_t layout, std::uint64_t keySize, std::uint64_t valueSize,
+                                                 std::uint64_t entrySize, std::uint64_t count) {
+            SnapshotHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+            header.version = SNAPSHOT_VERSION;
+            header.layout = layout;
+            header.keySize = keySize;
+            header.valueSize = valueSize;
+            header.entrySize = entrySize;
+            header.count = count;
+            header.entriesOffset = alignSnapshotOffset(sizeof(SnapshotHeader));
+            header.fileSize = header.entriesOffset + count * entrySize;
+            return header;
+        }
+
+        // Writes the elements of [first, last) as entries, in order, in
+        // chunks; padding bytes are zeroed so equal maps give equal files.
+        template<typename KeyType, typename ValueType, typename InputIt>
+        void writeSnapshotEntries(SnapshotWriter &writer, InputIt first, InputIt last) {
+            using Entry = SnapshotEntry<KeyType, ValueType>;
+            const std::size_t CHUNK = 1024;
+
+            std::vector<unsigned char> buffer(CHUNK * sizeof(Entry));
+            std::size_t used = 0;
+
+            for (; first != last; ++first) {
+                if (used == CHUNK) {
+                    writer.write(buffer.data(), used * sizeof(Entry));
+                    std::memset(buffer.data(), 0, buffer.size());
+                    used = 0;
+                }
+                new (buffer.data() + used * sizeof(Entry)) Entry{first->first, first->second};
+                ++used;
+            }
+
+            writer.write(buffer.data(), used * sizeof(Entry));
+        }
+
+        // Entries of a mapped snapshot seen as value_type pairs, for the bulk
+        // constructors that take an input iterator.
+        template<typename KeyType, typename ValueType>
+        class SnapshotPairIterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::pair<const KeyType, ValueType>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type *;
+            using reference = value_type;
+
+            const SnapshotEntry<KeyType, ValueType> *entry;
+
+            explicit SnapshotPairIterator(const SnapshotEntry<KeyType, ValueType> *entry): entry(entry) {}
+
+            value_type operator*() const {
+                return value_type(entry->first, entry->second);
+            }
+
+            SnapshotPairIterator &operator++() {
+                ++entry;
+                return *this;
+            }
+
+            bool operator==(const SnapshotPairIterator &other) const {
+                return entry == other.entry;
+            }
+
+            bool operator!=(const SnapshotPairIterator &other) const {
+                return entry != other.entry;
+            }
+        };
+
+        template<typename Map>
+        struct SnapshotLoader;
+
+        template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+        struct SnapshotLoader<TreeMap<KeyType, ValueType, Compare, Allocator>> {
+            using Map = TreeMap<KeyType, ValueType, Compare, Allocator>;
+
+            static Map load(const std::string &path) {
+                checkSnapshotTypes<KeyType, ValueType>();
+
+                MappedFile file(path);
+                const SnapshotHeader &header = openSnapshot<KeyType, ValueType>(file, path, 0);
+                auto entries = reinterpret_cast<const SnapshotEntry<KeyType, ValueType> *>(file.data + header.entriesOffset);
+
+                // sorted entries link up in O(n), no search per element
+                if (header.layout == SORTED_SNAPSHOT)
+                    return Map::fromSortedN(SnapshotPairIterator<KeyType, ValueType>(entries), (std::size_t) header.count);
+
+                Map map;
+                for (std::uint64_t i = 0; i < header.count; ++i) map.try_emplace(entries[i].first, entries[i].second);
+                return map;
+            }
+        };
+
+        template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+        struct SnapshotLoader<HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>> {
+            using Map = HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>;
+
+            static Map load(const std::string &path) {
+                checkSnapshotTypes<KeyType, ValueType>();
+
+                MappedFile file(path);
+                const SnapshotHeader &header = openSnapshot<KeyType, ValueType>(file, path, 0);
+                auto entries = reinterpret_cast<const SnapshotEntry<KeyType, ValueType> *>(file.data + header.entriesOffset);
+
+                Map map;
+                map.reserve((std::size_t) header.count);
+                for (std::uint64_t i = 0; i < header.count; ++i) map.try_emplace(entries[i].first, entries[i].second);
+                return map;
+            }
+        };
+
+    }
+
+    // Writes map to path in the sorted layout, replacing the file.
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    void save(const TreeMap<KeyType, ValueType, Compare, Allocator> &map, const std::string &path) {
+        detail::checkSnapshotTypes<KeyType, ValueType>();
+
+        detail::SnapshotHeader header = detail::makeSnapshotHeader(
+                detail::SORTED_SNAPSHOT, sizeof(KeyType), sizeof(ValueType),
+                sizeof(SnapshotEntry<KeyType, ValueType>), map.getSize());
+
+        detail::SnapshotWriter writer(path);
+        writer.write(&header, sizeof(header));
+        writer.pad(header.entriesOffset);
+        detail::writeSnapshotEntries<KeyType, ValueType>(writer, map.cbegin(), map.cend());
+        writer.close();
+    }
+
+    // Writes map to path in the hashed layout, replacing the file. The index
+    // is built with the map's own hasher, so a MappedHashMap reading it must
+    // use the same Hash, and that Hash must not vary between processes.
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+    void save(const HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator> &map, const std::string &path) {
+        detail::checkSnapshotTypes<KeyType, ValueType>();
+
+        using Entry = SnapshotEntry<KeyType, ValueType>;
+
+        detail::SnapshotHeader header = detail::makeSnapshotHeader(
+                detail::HASHED_SNAPSHOT, sizeof(KeyType), sizeof(ValueType), sizeof(Entry), map.getSize());
+
+        // at most half full, so probe runs stay short
+        header.slotCount = 1;
+        while (header.slotCount < 2 * header.count) header.slotCount *= 2;
+        header.slotsOffset = detail::alignSnapshotOffset(header.fileSize);
+        header.fileSize = header.slotsOffset + header.slotCount * sizeof(std::uint64_t);
+
+        std::vector<std::uint64_t> slots((std::size_t) header.slotCount, 0);
+        std::uint64_t index = 0;
+        for (auto it = map.cbegin(); it != map.cend(); ++it) {
+            std::uint64_t slot = detail::snapshotSlot(map.hashFunction, it->first, header.slotCount);
+            while (slots[slot] != 0) slot = (slot + 1) & (header.slotCount - 1);
+            slots[slot] = ++index;
+        }
+
+        detail::SnapshotWriter writer(path);
+        writer.write(&header, sizeof(header));
+        writer.pad(header.entriesOffset);
+        detail::writeSnapshotEntries<KeyType, ValueType>(writer, map.cbegin(), map.cend());
+        writer.pad(header.slotsOffset);
+        writer.write(slots.data(), slots.size() * sizeof(std::uint64_t));
+        writer.close();
+    }
+
+    // Builds a TreeMap or HashMap from a snapshot of either layout. A sorted
+    // snapshot loads into a TreeMap in O(n); if it is not sorted by the
+    // TreeMap's Compare, that throws std::invalid_argument.
+    template<typename Map>
+    Map load(const std::string &path) {
+        return detail::SnapshotLoader<Map>::load(path);
+    }
+
+    // Read-only view of a sorted snapshot: binary search over the mapped
+    // entries, nothing is copied or parsed when the file is opened. Compare
+    // must order keys the way the saved TreeMap did.
+    template<typename KeyType, typename ValueType, typename Compare = std::less<KeyType>>
+    class MappedTreeMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = SnapshotEntry<KeyType, ValueType>;
+        using size_type = std::size_t;
+        using const_iterator = const value_type *;
+        using iterator = const_iterator;
+
+        detail::MappedFile file;
+        const value_type *entries;
+        size_type length;
+        Compare compare;
+
+        explicit MappedTreeMap(const std::string &path, const Compare &compare = Compare())
+                : file(path), entries(nullptr), length(0), compare(compare) {
+            detail::checkSnapshotTypes<KeyType, ValueType>();
+
+            const detail::SnapshotHeader &header =
+                    detail::openSnapshot<KeyType, ValueType>(file, path, detail::SORTED_SNAPSHOT);
+            entries = reinterpret_cast<const value_type *>(file.data + header.entriesOffset);
+            length = (size_type) header.count;
+        }
+
+        bool isEmpty() const {
+            return length == 0;
+        }
+
+        size_type getSize() const {
+            return length;
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            const_iterator it = find(key);
+            if (it == end()) throw std::out_of_range("");
+
+            return it->second;
+        }
+
+        const_iterator find(const key_type &key) const {
+            const_iterator it = lower_bound(key);
+            return it != end() && !compare(key, it->first) ? it : end();
+        }
+
+        bool contains(const key_type &key) const {
+            return find(key) != end();
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        const_iterator lower_bound(const key_type &key) const {
+            const Compare &less = compare;
+            return std::lower_bound(begin(), end(), key,
+                                    [&less](const value_type &entry, const key_type &k) { return less(entry.first, k); });
+        }
+
+        const_iterator upper_bound(const key_type &key) const {
+            const Compare &less = compare;
+            return std::upper_bound(begin(), end(), key,
+                                    [&less](const key_type &k, const value_type &entry) { return less(k, entry.first); });
+        }
+
+        const_iterator begin() const {
+            return entries;
+        }
+
+        const_iterator end() const {
+            return entries + length;
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+    };
+
+    // Read-only view of a hashed snapshot: linear probing over the mapped
+    // index. Iteration follows the order the entries were saved in.
+    template<typename KeyType, typename ValueType, typename Hash = FastHash<KeyType>,
+            typename KeyEqual = std::equal_to<KeyType>>
+    class MappedHashMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = SnapshotEntry<KeyType, ValueType>;
+        using size_type = std::size_t;
+        using const_iterator = const value_type *;
+        using iterator = const_iterator;
+
+        detail::MappedFile file;
+        const value_type *entries;
+        const std::uint64_t *slots;
+        size_type length;
+        std::uint64_t slotCount;
+        Hash hashFunction;
+        KeyEqual keyEqual;
+
+        explicit MappedHashMap(const std::string &path, const Hash &hash = Hash(), const KeyEqual &equal = KeyEqual())
+                : file(path), entries(nullptr), slots(nullptr), length(0), slotCount(0),
+                  hashFunction(hash), keyEqual(equal) {
+            detail::checkSnapshotTypes<KeyType, ValueType>();
+
+            const detail::SnapshotHeader &header =
+                    detail::openSnapshot<KeyType, ValueType>(file, path, detail::HASHED_SNAPSHOT);
+            entries = reinterpret_cast<const value_type *>(file.data + header.entriesOffset);
+            slots = reinterpret_cast<const std::uint64_t *>(file.data + header.slotsOffset);
+            length = (size_type) header.count;
+            slotCount = header.slotCount;
+        }
+
+        bool isEmpty() const {
+            return length == 0;
+        }
+
+        size_type getSize() const {
+            return length;
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            const_iterator it = find(key);
+            if (it == end()) throw std::out_of_range("");
+
+            return it->second;
+        }
+
+        // The table is at most half full, so a probe soon reaches an empty
+        // slot; the bounds only matter for a corrupt file.
+        const_iterator find(const key_type &key) const {
+            std::uint64_t slot = detail::snapshotSlot(hashFunction, key, slotCount);
+
+            for (std::uint64_t probes = 0; probes < slotCount; ++probes) {
+                std::uint64_t index = slots[slot];
+                if (index == 0 || index > length) break;
+                if (keyEqual(entries[index - 1].first, key)) return entries + (index - 1);
+
+                slot = (slot + 1) & (slotCount - 1);
+            }
+
+            return end();
+        }
+
+        bool contains(const key_type &key) const {
+            return find(key) != end();
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        const_iterator begin() const {
+            return entries;
+        }
+
+        const_iterator end() const {
+            return entries + length;
+        }
+
+        const_iterator cbegin() const {
+            return begin();
+        }
+
+        const_iterator cend() const {
+            return end();
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_MAPPED_MAP_H */
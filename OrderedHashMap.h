@@ -0,0 +1,639 @@
+#ifndef AISDI_MAPS_ORDEREDHASHMAP_H
+#define AISDI_MAPS_ORDEREDHASHMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "Config.h"
+#include "Hashing.h"
+#include "TransparentLookup.h"
+
+namespace aisdi {
+
+    // Hash map that iterates in insertion order, laid out like CPython's
+    // compact dict: the elements sit in one dense entries array in the order
+    // they were added, and a separate table of 32-bit entry indices, open
+    // addressed with linear probing, finds them by hash. Iterating is a scan
+    // of the entries array, the same for every table size and history of
+    // growth. Each entry keeps its hash, so probes compare hashes before keys
+    // and growing never rehashes a key.
+    //
+    // The index table always has at least 3/2 as many slots as the entries
+    // array, so it stays at most 2/3 full, removed entries included. Removing
+    // leaves a hole in the entries array and a deleted mark in the index; the
+    // holes are squeezed out the next time the entries array fills up, or by
+    // compact().
+    //
+    // Removing invalidates only iterators to the removed element. Inserting
+    // invalidates end(), and when the entries array grows or is compacted,
+    // every iterator and reference.
+    template<typename KeyType, typename ValueType,
+            typename Hash = FastHash<KeyType>, typename KeyEqual = std::equal_to<KeyType>>
+    class OrderedHashMap {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using value_type = std::pair<const key_type, mapped_type>;
+        using size_type = std::size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+
+        class ConstIterator;
+
+        class Iterator;
+
+        using iterator = Iterator;
+        using const_iterator = ConstIterator;
+
+        class Entry {
+        public:
+            typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type storage;
+            std::size_t hash;
+            bool live;
+
+            value_type &value() {
+                return *reinterpret_cast<value_type *>(&storage);
+            }
+
+            const value_type &value() const {
+                return *reinterpret_cast<const value_type *>(&storage);
+            }
+        };
+
+        static const size_type INITIAL_CAPACITY = 8;
+        static const std::uint32_t EMPTY = 0xFFFFFFFFu;
+        static const std::uint32_t DELETED = 0xFFFFFFFEu;
+
+        // entries[0, used) in insertion order, elementCount of them live
+        Entry *entries;
+        size_type entryCapacity;
+        size_type used;
+        size_type elementCount;
+        // lowest live entry, used when there is none; keeps begin() O(1)
+        size_type head;
+        std::uint32_t *indices;
+        size_type indexCapacity;
+        Hash hashFunction;
+        KeyEqual keyEqual;
+
+        OrderedHashMap(): OrderedHashMap(Hash(), KeyEqual()) {}
+
+        OrderedHashMap(const Hash &hash, const KeyEqual &equal)
+                : entries(nullptr), entryCapacity(0), used(0), elementCount(0), head(0),
+                  indices(nullptr), indexCapacity(0), hashFunction(hash), keyEqual(equal) {
+            allocate(INITIAL_CAPACITY);
+        }
+
+        ~OrderedHashMap() {
+            destroyAll();
+            deallocate();
+        }
+
+        OrderedHashMap(std::initializer_list<value_type> list): OrderedHashMap() {
+            reserve(list.size());
+
+            for (auto it = list.begin(); it != list.end(); ++it) {
+                insert_or_assign(it->first, it->second);
+            }
+        }
+
+        void swapMap(OrderedHashMap &a, OrderedHashMap &b) {
+            std::swap(a.entries, b.entries);
+            std::swap(a.entryCapacity, b.entryCapacity);
+            std::swap(a.used, b.used);
+            std::swap(a.elementCount, b.elementCount);
+            std::swap(a.head, b.head);
+            std::swap(a.indices, b.indices);
+            std::swap(a.indexCapacity, b.indexCapacity);
+            std::swap(a.hashFunction, b.hashFunction);
+            std::swap(a.keyEqual, b.keyEqual);
+        }
+
+        // Copies keep the order of the original, without its holes.
+        OrderedHashMap(const OrderedHashMap &other): OrderedHashMap(other.hashFunction, other.keyEqual) {
+            reserve(other.elementCount);
+
+            for (auto it = other.begin(); it != other.end(); ++it) {
+                try_emplace(it->first, it->second);
+            }
+        }
+
+        OrderedHashMap(OrderedHashMap &&other): OrderedHashMap() {
+            swapMap(*this, other);
+        }
+
+        OrderedHashMap &operator=(OrderedHashMap other) {
+            swapMap(*this, other);
+            return *this;
+        }
+
+        bool isEmpty() const {
+            return elementCount == 0;
+        }
+
+        mapped_type &operator[](const key_type &key) {
+            return try_emplace(key).first->second;
+        }
+
+        mapped_type &operator[](key_type &&key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        // Builds the element from args only when key is missing; on a hit
+        // neither key nor args are touched. A new key goes last in the order.
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+            return emplaceUnique(key, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+            return emplaceUnique(std::move(key), std::forward<Args>(args)...);
+        }
+
+        // Assigning to an existing key keeps its place in the order.
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+            auto result = emplaceUnique(key, std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+            auto result = emplaceUnique(std::move(key), std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        // The key is only known once the element is built, so this constructs
+        // it in the next free entry and gives the entry back on a hit.
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args &&... args) {
+            if (used == entryCapacity) makeRoom();
+
+            Entry &entry = entries[used];
+            new (&entry.storage) value_type(std::forward<Args>(args)...);
+
+            std::size_t hash = hashOf(entry.value().first);
+            size_type slot = findSlot(entry.value().first, hash);
+            if (indices[slot] != EMPTY) {
+                entry.value().~value_type();
+                return std::make_pair(Iterator(ConstIterator(this, indices[slot])), false);
+            }
+
+            return std::make_pair(Iterator(ConstIterator(this, linkEntry(slot, hash))), true);
+        }
+
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceUnique(K &&key, Args &&... args) {
+            std::size_t hash = hashOf(key);
+            size_type slot = findSlot(key, hash);
+            if (indices[slot] != EMPTY) return std::make_pair(Iterator(ConstIterator(this, indices[slot])), false);
+
+            if (used == entryCapacity) {
+                makeRoom();
+                slot = findSlot(key, hash);
+            }
+
+            new (&entries[used].storage) value_type(std::piecewise_construct,
+                                                    std::forward_as_tuple(std::forward<K>(key)),
+                                                    std::forward_as_tuple(std::forward<Args>(args)...));
+
+            return std::make_pair(Iterator(ConstIterator(this, linkEntry(slot, hash))), true);
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            return entryOf(key).value().second;
+        }
+
+        mapped_type &valueOf(const key_type &key) {
+            return entryOf(key).value().second;
+        }
+
+        const_iterator find(const key_type &key) const {
+            return ConstIterator(this, findEntry(key));
+        }
+
+        iterator find(const key_type &key) {
+            return Iterator(ConstIterator(this, findEntry(key)));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        const mapped_type &valueOf(const K &key) const {
+            return entryOf(key).value().second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        mapped_type &valueOf(const K &key) {
+            return entryOf(key).value().second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        const_iterator find(const K &key) const {
+            return ConstIterator(this, findEntry(key));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        iterator find(const K &key) {
+            return Iterator(ConstIterator(this, findEntry(key)));
+        }
+
+        bool contains(const key_type &key) const {
+            return findEntry(key) != used;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        bool contains(const K &key) const {
+            return findEntry(key) != used;
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        size_type count(const K &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        void remove(const key_type &key) {
+            remove(find(key));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Hash, KeyEqual>>
+        void remove(const K &key) {
+            remove(find(key));
+        }
+
+        void remove(const const_iterator &it) {
+            if (it.map != this || it.index >= used || !entries[it.index].live) throw std::out_of_range("");
+
+            Entry &entry = entries[it.index];
+            size_type slot = entry.hash & (indexCapacity - 1);
+            while (indices[slot] != it.index) slot = (slot + 1) & (indexCapacity - 1);
+
+            indices[slot] = DELETED;
+            entry.value().~value_type();
+            entry.live = false;
+            --elementCount;
+
+            if (it.index == head) head = nextLive(head + 1);
+        }
+
+        size_type getSize() const {
+            return elementCount;
+        }
+
+        // Drops every element but keeps both arrays for reuse.
+        void clear() {
+            destroyAll();
+
+            for (size_type i = 0; i < indexCapacity; ++i) {
+                indices[i] = EMPTY;
+            }
+
+            used = 0;
+            elementCount = 0;
+            head = 0;
+        }
+
+        // Squeezes the holes left by remove out of the entries array.
+        void compact() {
+            if (elementCount != used) rebuild(entryCapacity);
+        }
+
+        void reserve(size_type n) {
+            if (n > entryCapacity) rebuild(n);
+        }
+
+        // Equal when both hold the same key-value pairs, in any order, as
+        // for the other maps.
+        bool operator==(const OrderedHashMap &other) const {
+            if (elementCount != other.elementCount) return false;
+
+            for (auto it = cbegin(); it != cend(); ++it) {
+                auto it2 = other.find(it->first);
+                if (it2 == other.cend() || it->second != it2->second) return false;
+            }
+
+            return true;
+        }
+
+        bool operator!=(const OrderedHashMap &other) const {
+            return !operator==(other);
+        }
+
+        iterator begin() {
+            return Iterator(cbegin());
+        }
+
+        iterator end() {
+            return Iterator(cend());
+        }
+
+        const_iterator cbegin() const {
+            return ConstIterator(this, head);
+        }
+
+        const_iterator cend() const {
+            return ConstIterator(this, used);
+        }
+
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        const_iterator end() const {
+            return cend();
+        }
+
+        template<typename K>
+        std::size_t hashOf(const K &key) const {
+            std::size_t hash = hashFunction(key);
+            return detail::IsAvalanching<Hash>::value ? hash : (std::size_t) detail::mix64(hash);
+        }
+
+        // Index slot holding key, or the empty slot that ends its probe.
+        template<typename K>
+        size_type findSlot(const K &key, std::size_t hash) const {
+            size_type slot = hash & (indexCapacity - 1);
+
+            for (;; slot = (slot + 1) & (indexCapacity - 1)) {
+                std::uint32_t index = indices[slot];
+                if (index == EMPTY) return slot;
+                if (index != DELETED && entries[index].hash == hash && keyEqual(entries[index].value().first, key))
+                    return slot;
+            }
+        }
+
+        // Entry holding key, or used when it is missing.
+        template<typename K>
+        size_type findEntry(const K &key) const {
+            std::uint32_t index = indices[findSlot(key, hashOf(key))];
+            return index == EMPTY ? used : index;
+        }
+
+        // Entry holding key; a missing key is an error whether or not
+        // iterators are checked.
+        template<typename K>
+        Entry &entryOf(const K &key) const {
+            size_type index = findEntry(key);
+
+            if (index == used) throw std::out_of_range("");
+
+            return entries[index];
+        }
+
+        size_type nextLive(size_type index) const {
+            while (index < used && !entries[index].live) ++index;
+
+            return index;
+        }
+
+    private:
+        void allocate(size_type capacity) {
+            if (capacity >= DELETED) throw std::length_error("");
+
+            size_type slots = 1;
+            while (slots < capacity + capacity / 2) slots *= 2;
+
+            // held until the entries are allocated too, so either failing
+            // leaves the map as it was
+            std::unique_ptr<std::uint32_t[]> newIndices(new std::uint32_t[slots]);
+            for (size_type i = 0; i < slots; ++i) newIndices[i] = EMPTY;
+
+            entries = std::allocator<Entry>().allocate(capacity);
+            entryCapacity = capacity;
+            indices = newIndices.release();
+            indexCapacity = slots;
+        }
+
+        void deallocate() {
+            std::allocator<Entry>().deallocate(entries, entryCapacity);
+            delete [] indices;
+        }
+
+        void destroyAll() {
+            for (size_type i = head; i < used; ++i) {
+                if (entries[i].live) entries[i].value().~value_type();
+            }
+        }
+
+        // Gives the element just built in entries[used] its index slot.
+        size_type linkEntry(size_type slot, std::size_t hash) {
+            Entry &entry = entries[used];
+            entry.hash = hash;
+            entry.live = true;
+            indices[slot] = (std::uint32_t) used;
+
+            if (elementCount == 0) head = used;
+            ++elementCount;
+            return used++;
+        }
+
+        // The entries array is full: squeeze out the holes if at least a
+        // quarter of it is holes, else double it.
+        void makeRoom() {
+            rebuild(elementCount * 4 <= used * 3 ? entryCapacity : entryCapacity * 2);
+        }
+
+        // Moves the live entries, in order, into fresh arrays with room for
+        // capacity of them. Elements whose move may throw are copied, so a
+        // failure leaves the map as it was.
+        void rebuild(size_type capacity) {
+            if (capacity < elementCount) capacity = elementCount;
+            if (capacity < INITIAL_CAPACITY) capacity = INITIAL_CAPACITY;
+
+            Entry *oldEntries = entries;
+            size_type oldCapacity = entryCapacity;
+            size_type oldUsed = used;
+            size_type oldHead = head;
+            std::uint32_t *oldIndices = indices;
+            size_type oldIndexCapacity = indexCapacity;
+
+            allocate(capacity);
+
+            size_type moved = 0;
+            try {
+                for (size_type i = oldHead; i < oldUsed; ++i) {
+                    if (!oldEntries[i].live) continue;
+
+                    new (&entries[moved].storage) value_type(std::move_if_noexcept(oldEntries[i].value()));
+                    entries[moved].hash = oldEntries[i].hash;
+                    entries[moved].live = true;
+                    ++moved;
+                }
+            }
+            catch (...) {
+                for (size_type i = 0; i < moved; ++i) entries[i].value().~value_type();
+                deallocate();
+
+                entries = oldEntries;
+                entryCapacity = oldCapacity;
+                indices = oldIndices;
+                indexCapacity = oldIndexCapacity;
+                throw;
+            }
+
+            for (size_type i = oldHead; i < oldUsed; ++i) {
+                if (oldEntries[i].live) oldEntries[i].value().~value_type();
+            }
+            std::allocator<Entry>().deallocate(oldEntries, oldCapacity);
+            delete [] oldIndices;
+
+            used = moved;
+            head = 0;
+
+            for (size_type i = 0; i < used; ++i) {
+                size_type slot = entries[i].hash & (indexCapacity - 1);
+                while (indices[slot] != EMPTY) slot = (slot + 1) & (indexCapacity - 1);
+                indices[slot] = (std::uint32_t) i;
+            }
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+    class OrderedHashMap<KeyType, ValueType, Hash, KeyEqual>::ConstIterator {
+    public:
+        using reference = typename OrderedHashMap::const_reference;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename OrderedHashMap::value_type;
+        using pointer = const typename OrderedHashMap::value_type *;
+
+        const OrderedHashMap *map;
+        size_type index;
+
+        explicit ConstIterator() {
+            map = nullptr;
+            index = 0;
+        }
+
+        ConstIterator(const OrderedHashMap *map, size_type index) {
+            this->map = map;
+            this->index = index;
+        }
+
+        ConstIterator(const ConstIterator &other) {
+            map = other.map;
+            index = other.index;
+        }
+
+        ConstIterator &operator++() {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (index >= map->used) throw std::out_of_range("");
+#endif
+
+            index = map->nextLive(index + 1);
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator it(*this);
+            this->operator++();
+            return it;
+        }
+
+        ConstIterator &operator--() {
+            size_type prev = index;
+
+            while (prev > map->head) {
+                --prev;
+                if (map->entries[prev].live) {
+                    index = prev;
+                    return *this;
+                }
+            }
+
+#if AISDI_MAPS_CHECKED_ITERATORS
+            throw std::out_of_range("");
+#endif
+            return *this;
+        }
+
+        ConstIterator operator--(int) {
+            ConstIterator it(*this);
+            this->operator--();
+            return it;
+        }
+
+        reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (index >= map->used) throw std::out_of_range("");
+#endif
+
+            return map->entries[index].value();
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        bool operator==(const ConstIterator &other) const {
+            return map == other.map && index == other.index;
+        }
+
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+    class OrderedHashMap<KeyType, ValueType, Hash, KeyEqual>::Iterator
+            : public OrderedHashMap<KeyType, ValueType, Hash, KeyEqual>::ConstIterator {
+    public:
+        using reference = typename OrderedHashMap::reference;
+        using pointer = typename OrderedHashMap::value_type *;
+
+        explicit Iterator() {}
+
+        Iterator(const ConstIterator &other)
+                : ConstIterator(other) {}
+
+        Iterator &operator++() {
+            ConstIterator::operator++();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto result = *this;
+            ConstIterator::operator++();
+            return result;
+        }
+
+        Iterator &operator--() {
+            ConstIterator::operator--();
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            auto result = *this;
+            ConstIterator::operator--();
+            return result;
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        reference operator*() const {
+            // ugly cast, yet reduces code duplication.
+            return const_cast<reference>(ConstIterator::operator*());
+        }
+    };
+
+}
+
+#endif /* AISDI_MAPS_ORDEREDHASHMAP_H */
@@ -0,0 +1,191 @@
+#ifndef AISDI_MAPS_POOLALLOCATOR_H
+#define AISDI_MAPS_POOLALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace aisdi {
+
+    // Carves fixed-size chunks out of large slabs. Freed chunks go onto an
+    // intrusive free list and are handed out again before the current slab is
+    // bumped any further. release() gives every slab back in one shot, whether
+    // or not its chunks were deallocated.
+    class NodeArena {
+    public:
+        using size_type = std::size_t;
+
+        NodeArena(size_type chunkSize, size_type slabBytes)
+                : chunkSize(chunkSize), slabBytes(slabBytes), slabs(nullptr), freeList(nullptr),
+                  cursor(nullptr), limit(nullptr) {}
+
+        NodeArena(const NodeArena &) = delete;
+
+        NodeArena &operator=(const NodeArena &) = delete;
+
+        ~NodeArena() {
+            release();
+        }
+
+        void *allocate() {
+            if (freeList != nullptr) {
+                FreeChunk *chunk = freeList;
+                freeList = chunk->next;
+                return chunk;
+            }
+
+            if (cursor == limit) grow();
+
+            void *chunk = cursor;
+            cursor += chunkSize;
+            return chunk;
+        }
+
+        void deallocate(void *chunk) {
+            FreeChunk *freed = static_cast<FreeChunk *>(chunk);
+            freed->next = freeList;
+            freeList = freed;
+        }
+
+        void release() {
+            while (slabs != nullptr) {
+                Slab *next = slabs->next;
+                ::operator delete(slabs);
+                slabs = next;
+            }
+
+            freeList = nullptr;
+            cursor = limit = nullptr;
+        }
+
+        size_type getChunkSize() const {
+            return chunkSize;
+        }
+
+    private:
+        struct FreeChunk {
+            FreeChunk *next;
+        };
+
+        union Slab {
+            Slab *next;
+            std::max_align_t align;
+        };
+
+        void grow() {
+            size_type count = slabBytes > sizeof(Slab) + chunkSize ? (slabBytes - sizeof(Slab)) / chunkSize : 1;
+            char *raw = static_cast<char *>(::operator new(sizeof(Slab) + count * chunkSize));
+
+            Slab *slab = reinterpret_cast<Slab *>(raw);
+            slab->next = slabs;
+            slabs = slab;
+
+            cursor = raw + sizeof(Slab);
+            limit = cursor + count * chunkSize;
+        }
+
+        size_type chunkSize;
+        size_type slabBytes;
+        Slab *slabs;
+        FreeChunk *freeList;
+        char *cursor;
+        char *limit;
+    };
+
+    // Allocator for node-based maps: single-object requests come from a
+    // NodeArena, anything else goes to operator new. Copies share the arena;
+    // rebinding to a type of a different size starts a new one, which is what
+    // a map does once when it rebinds the allocator to its node type.
+    //
+    // A container copy gets a fresh arena, so a map whose arena is not shared
+    // with anyone may release() all of its nodes at once when it is destroyed.
+    template<typename T, std::size_t SlabBytes = 64 * 1024>
+    class PoolAllocator {
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+        using propagate_on_container_copy_assignment = std::false_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        template<typename U>
+        struct rebind {
+            using other = PoolAllocator<U, SlabBytes>;
+        };
+
+        std::shared_ptr<NodeArena> arena;
+
+        PoolAllocator(): arena(std::make_shared<NodeArena>(chunkSize(), SlabBytes)) {}
+
+        template<typename U>
+        PoolAllocator(const PoolAllocator<U, SlabBytes> &other)
+                : arena(other.arena->getChunkSize() == chunkSize()
+                        ? other.arena : std::make_shared<NodeArena>(chunkSize(), SlabBytes)) {}
+
+        T *allocate(size_type n) {
+            if (n != 1) return static_cast<T *>(::operator new(n * sizeof(T)));
+
+            return static_cast<T *>(arena->allocate());
+        }
+
+        void deallocate(T *p, size_type n) {
+            if (n != 1) ::operator delete(p);
+            else arena->deallocate(p);
+        }
+
+        PoolAllocator select_on_container_copy_construction() const {
+            return PoolAllocator();
+        }
+
+        bool canRelease() const {
+            return arena.use_count() == 1;
+        }
+
+        void release() {
+            arena->release();
+        }
+
+        static size_type chunkSize() {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+            size_type align = alignof(T) > alignof(void *) ? alignof(T) : alignof(void *);
+            size_type size = sizeof(T) > sizeof(void *) ? sizeof(T) : sizeof(void *);
+            return (size + align - 1) / align * align;
+        }
+    };
+
+    template<typename T, typename U, std::size_t SlabBytes>
+    bool operator==(const PoolAllocator<T, SlabBytes> &a, const PoolAllocator<U, SlabBytes> &b) {
+        return a.arena == b.arena;
+    }
+
+    template<typename T, typename U, std::size_t SlabBytes>
+    bool operator!=(const PoolAllocator<T, SlabBytes> &a, const PoolAllocator<U, SlabBytes> &b) {
+        return !(a == b);
+    }
+
+    namespace detail {
+
+        // Lets the maps ask any allocator whether it can drop all of its
+        // nodes in one call; only allocators with release() ever say yes.
+        template<typename Allocator, typename = void>
+        struct BulkRelease {
+            static bool canRelease(const Allocator &) { return false; }
+
+            static void release(Allocator &) {}
+        };
+
+        template<typename Allocator>
+        struct BulkRelease<Allocator, decltype(void(std::declval<Allocator &>().release()))> {
+            static bool canRelease(const Allocator &allocator) { return allocator.canRelease(); }
+
+            static void release(Allocator &allocator) { allocator.release(); }
+        };
+
+    }
+
+}
+
+#endif /* AISDI_MAPS_POOLALLOCATOR_H */
@@ -0,0 +1,480 @@
+#ifndef AISDI_MAPS_SERIALIZATION_H
+#define AISDI_MAPS_SERIALIZATION_H
+
+// Streaming binary format for maps whose keys and values need not be
+// trivially copyable (see MappedMap.h for the ones that are).
+//
+//   aisdi::serialize(tree, out);                        // any std::ostream
+//   auto copy = aisdi::deserialize<aisdi::TreeMap<std::string, std::string>>(in);
+//
+// A stream is a header followed by the records, one per element, each a
+// varint byte length and then the encoded key and value. The record bytes are
+// cut into blocks of at most blockSize bytes. Each block is prefixed with its
+// length and optionally followed by a checksum, and a zero length block ends
+// the stream. A record may span blocks, so writer and reader hold at most one
+// block, plus the record in hand. Reading only goes forward, so a pipe
+// works as well as a file.
+//
+// Integers are stored as varints (zigzag for signed types) and floating point
+// values as little-endian IEEE bits, so streams move between machines. Other
+// types need a Codec specialization.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "HashMap.h"
+#include "TreeMap.h"
+
+namespace aisdi {
+
+    struct SerializationOptions {
+        // checksum every block, so a corrupt stream fails instead of loading
+        bool checksums = true;
+        std::size_t blockSize = 64 * 1024;
+    };
+
+    class StreamWriter;
+
+    class StreamReader;
+
+    // Encoding of one key or value: write appends it to a record, read
+    // decodes it from the record being read.
+    template<typename T, typename = void>
+    struct Codec;
+
+    namespace detail {
+
+        const char STREAM_MAGIC[8] = {'A', 'I', 'S', 'D', 'I', 'S', 'E', 'R'};
+        const unsigned char STREAM_VERSION = 1;
+        const unsigned char STREAM_CHECKSUMS = 1;
+        const unsigned char STREAM_SORTED = 2;
+        // largest block a reader accepts, whatever the header says
+        const std::uint64_t MAX_STREAM_BLOCK = 64 * 1024 * 1024;
+        // the element count comes from the unchecksummed header, so no more
+        // than this is reserved up front on its word
+        const std::uint64_t MAX_STREAM_RESERVE = 1 << 24;
+
+        // FNV-1a
+        inline std::uint32_t streamChecksum(const char *data, std::size_t size) {
+            std::uint32_t hash = 2166136261u;
+            for (std::size_t i = 0; i < size; ++i) {
+                hash ^= (unsigned char) data[i];
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        inline void putVarint(std::string &out, std::uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back((char) (value | 0x80));
+                value >>= 7;
+            }
+            out.push_back((char) value);
+        }
+
+        inline void putFixed(std::string &out, std::uint64_t value, int bytes) {
+            for (int i = 0; i < bytes; ++i) out.push_back((char) (value >> (8 * i)));
+        }
+
+        // Streams from TreeMap come out sorted and load with fromSortedN.
+        template<typename Map>
+        struct IsSortedStream : std::false_type {};
+
+        template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+        struct IsSortedStream<TreeMap<KeyType, ValueType, Compare, Allocator>> : std::true_type {};
+
+    }
+
+    class StreamWriter {
+    public:
+        std::ostream &out;
+        std::string block;
+        std::string record;
+        std::string prefix;
+        std::string frame;
+        std::size_t blockSize;
+        bool checksums;
+
+        // Writes the stream header for count records.
+        StreamWriter(std::ostream &out, std::uint64_t count, bool sorted, const SerializationOptions &options)
+                : out(out), blockSize(options.blockSize), checksums(options.checksums) {
+            if (blockSize == 0 || blockSize > detail::MAX_STREAM_BLOCK) throw std::invalid_argument("");
+            block.reserve(blockSize);
+
+            frame.assign(detail::STREAM_MAGIC, sizeof(detail::STREAM_MAGIC));
+            frame.push_back((char) detail::STREAM_VERSION);
+            frame.push_back((char) ((checksums ? detail::STREAM_CHECKSUMS : 0) | (sorted ? detail::STREAM_SORTED : 0)));
+            detail::putVarint(frame, blockSize);
+            detail::putVarint(frame, count);
+            emit(frame);
+        }
+
+        template<typename KeyType, typename ValueType>
+        void writeRecord(const KeyType &key, const ValueType &value) {
+            record.clear();
+            Codec<KeyType>::write(record, key);
+            Codec<ValueType>::write(record, value);
+
+            // not in frame, which flushBlock reuses while put is copying
+            prefix.clear();
+            detail::putVarint(prefix, record.size());
+            put(prefix.data(), prefix.size());
+            put(record.data(), record.size());
+        }
+
+        // Flushes the last block and writes the end marker.
+        void finish() {
+            flushBlock();
+            frame.assign(1, '\0');
+            emit(frame);
+            out.flush();
+            if (!out) throw std::runtime_error("cannot write map stream");
+        }
+
+        void put(const char *data, std::size_t size) {
+            while (size > 0) {
+                std::size_t chunk = std::min(size, blockSize - block.size());
+                block.append(data, chunk);
+                data += chunk;
+                size -= chunk;
+                if (block.size() == blockSize) flushBlock();
+            }
+        }
+
+        void flushBlock() {
+            if (block.empty()) return;
+
+            frame.clear();
+            detail::putVarint(frame, block.size());
+            emit(frame);
+            emit(block);
+            if (checksums) {
+                frame.clear();
+                detail::putFixed(frame, detail::streamChecksum(block.data(), block.size()), 4);
+                emit(frame);
+            }
+            block.clear();
+        }
+
+        void emit(const std::string &bytes) {
+            if (!out.write(bytes.data(), (std::streamsize) bytes.size())) throw std::runtime_error("cannot write map stream");
+        }
+    };
+
+    class StreamReader {
+    public:
+        std::istream &in;
+        std::vector<char> block;
+        std::size_t position;
+        std::uint64_t blockSize;
+        std::uint64_t count;
+        // bytes of the current record not read yet; a codec can never read
+        // past its record, however corrupt the lengths inside it are
+        std::uint64_t recordLeft;
+        bool checksums;
+        bool sorted;
+        bool ended;
+
+        // Reads and checks the stream header.
+        explicit StreamReader(std::istream &in)
+                : in(in), position(0), blockSize(0), count(0), recordLeft(0), checksums(false), sorted(false), ended(false) {
+            char magic[sizeof(detail::STREAM_MAGIC)];
+            if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, detail::STREAM_MAGIC, sizeof(magic)) != 0)
+                throw std::runtime_error("not a map stream");
+
+            if (rawByte() != detail::STREAM_VERSION) throw std::runtime_error("unsupported map stream version");
+            unsigned char flags = rawByte();
+            checksums = (flags & detail::STREAM_CHECKSUMS) != 0;
+            sorted = (flags & detail::STREAM_SORTED) != 0;
+
+            blockSize = rawVarint();
+            count = rawVarint();
+            if (blockSize == 0 || blockSize > detail::MAX_STREAM_BLOCK) throw std::runtime_error("corrupt map stream");
+        }
+
+        // Decodes the next record into key and value.
+        template<typename KeyType, typename ValueType>
+        std::pair<KeyType, ValueType> readRecord() {
+            recordLeft = std::numeric_limits<std::uint64_t>::max();
+            recordLeft = varint();
+
+            KeyType key = Codec<KeyType>::read(*this);
+            ValueType value = Codec<ValueType>::read(*this);
+            if (recordLeft != 0) throw std::runtime_error("corrupt map stream");
+
+            return std::pair<KeyType, ValueType>(std::move(key), std::move(value));
+        }
+
+        // Checks that the records are followed by the end marker.
+        void finish() {
+            if (position != block.size() || nextBlock()) throw std::runtime_error("corrupt map stream");
+        }
+
+        void get(char *data, std::size_t size) {
+            if (size > recordLeft) throw std::runtime_error("corrupt map stream");
+            recordLeft -= size;
+
+            while (size > 0) {
+                if (position == block.size() && !nextBlock()) throw std::runtime_error("truncated map stream");
+
+                std::size_t chunk = std::min(size, block.size() - position);
+                std::memcpy(data, block.data() + position, chunk);
+                position += chunk;
+                data += chunk;
+                size -= chunk;
+            }
+        }
+
+        std::uint64_t varint() {
+            std::uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                char byte;
+                get(&byte, 1);
+                value |= (std::uint64_t) ((unsigned char) byte & 0x7F) << shift;
+                if (((unsigned char) byte & 0x80) == 0) return value;
+            }
+            throw std::runtime_error("corrupt map stream");
+        }
+
+        bool nextBlock() {
+            if (ended) return false;
+
+            std::uint64_t size = rawVarint();
+            if (size == 0) {
+                ended = true;
+                return false;
+            }
+            if (size > blockSize) throw std::runtime_error("corrupt map stream");
+
+            block.resize((std::size_t) size);
+            if (!in.read(block.data(), (std::streamsize) size)) throw std::runtime_error("truncated map stream");
+            position = 0;
+
+            if (checksums) {
+                std::uint32_t stored = 0;
+                for (int i = 0; i < 4; ++i) stored |= (std::uint32_t) rawByte() << (8 * i);
+                if (stored != detail::streamChecksum(block.data(), block.size()))
+                    throw std::runtime_error("map stream checksum mismatch");
+            }
+
+            return true;
+        }
+
+        unsigned char rawByte() {
+            char byte;
+            if (!in.get(byte)) throw std::runtime_error("truncated map stream");
+            return (unsigned char) byte;
+        }
+
+        std::uint64_t rawVarint() {
+            std::uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                unsigned char byte = rawByte();
+                value |= (std::uint64_t) (byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) return value;
+            }
+            throw std::runtime_error("corrupt map stream");
+        }
+    };
+
+    template<>
+    struct Codec<bool> {
+        static void write(std::string &out, bool value) {
+            out.push_back(value ? 1 : 0);
+        }
+
+        static bool read(StreamReader &in) {
+            char byte;
+            in.get(&byte, 1);
+            if (byte != 0 && byte != 1) throw std::runtime_error("corrupt map stream");
+            return byte == 1;
+        }
+    };
+
+    template<typename T>
+    struct Codec<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type> {
+        static void write(std::string &out, T value) {
+            detail::putVarint(out, (std::uint64_t) value);
+        }
+
+        static T read(StreamReader &in) {
+            std::uint64_t value = in.varint();
+            if (value > (std::uint64_t) std::numeric_limits<T>::max()) throw std::runtime_error("corrupt map stream");
+            return (T) value;
+        }
+    };
+
+    template<typename T>
+    struct Codec<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type> {
+        static void write(std::string &out, T value) {
+            std::uint64_t bits = (std::uint64_t) (std::int64_t) value;
+            detail::putVarint(out, (bits << 1) ^ (value < 0 ? ~(std::uint64_t) 0 : 0));
+        }
+
+        static T read(StreamReader &in) {
+            std::uint64_t zigzag = in.varint();
+            std::int64_t value = (std::int64_t) (zigzag >> 1) ^ -(std::int64_t) (zigzag & 1);
+            if (value < (std::int64_t) std::numeric_limits<T>::min() || value > (std::int64_t) std::numeric_limits<T>::max())
+                throw std::runtime_error("corrupt map stream");
+            return (T) value;
+        }
+    };
+
+    template<typename T>
+    struct Codec<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only 32 and 64 bit floating point values are supported");
+
+        using Bits = typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type;
+
+        static void write(std::string &out, T value) {
+            Bits bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            detail::putFixed(out, bits, sizeof(bits));
+        }
+
+        static T read(StreamReader &in) {
+            unsigned char bytes[sizeof(Bits)];
+            in.get(reinterpret_cast<char *>(bytes), sizeof(bytes));
+
+            Bits bits = 0;
+            for (std::size_t i = 0; i < sizeof(bits); ++i) bits |= (Bits) bytes[i] << (8 * i);
+
+            T value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    };
+
+    template<>
+    struct Codec<std::string> {
+        static void write(std::string &out, const std::string &value) {
+            detail::putVarint(out, value.size());
+            out.append(value);
+        }
+
+        // get refuses a length past the record, so a corrupt one fails
+        // before anything that large is allocated
+        static std::string read(StreamReader &in) {
+            std::uint64_t size = in.varint();
+            if (size > in.recordLeft) throw std::runtime_error("corrupt map stream");
+
+            std::string value((std::size_t) size, '\0');
+            if (size > 0) in.get(&value[0], value.size());
+            return value;
+        }
+    };
+
+    namespace detail {
+
+        // Hands the records of a stream to a bulk constructor one at a time,
+        // moving each out; no more than one is decoded ahead.
+        template<typename KeyType, typename ValueType>
+        class RecordIterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::pair<KeyType, ValueType>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = value_type *;
+            using reference = value_type &&;
+
+            StreamReader *reader;
+            std::uint64_t left;
+            value_type current;
+
+            RecordIterator(StreamReader &reader, std::uint64_t count): reader(&reader), left(count) {
+                if (left > 0) current = reader.readRecord<KeyType, ValueType>();
+            }
+
+            reference operator*() {
+                return std::move(current);
+            }
+
+            RecordIterator &operator++() {
+                if (--left > 0) current = reader->readRecord<KeyType, ValueType>();
+                return *this;
+            }
+        };
+
+        template<typename Map>
+        struct StreamLoader;
+
+        template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+        struct StreamLoader<TreeMap<KeyType, ValueType, Compare, Allocator>> {
+            using Map = TreeMap<KeyType, ValueType, Compare, Allocator>;
+
+            static Map load(StreamReader &reader) {
+                if (reader.sorted) {
+                    // sorted by the writer's Compare, which may not be ours;
+                    // the records already read are gone, so that is an error
+                    try {
+                        RecordIterator<KeyType, ValueType> records(reader, reader.count);
+                        return Map::fromSortedN(records, (std::size_t) reader.count);
+                    }
+                    catch (const std::invalid_argument &) {
+                        throw std::runtime_error("map stream is not sorted by this map's order");
+                    }
+                }
+
+                Map map;
+                for (std::uint64_t i = 0; i < reader.count; ++i) {
+                    auto record = reader.readRecord<KeyType, ValueType>();
+                    map.try_emplace(std::move(record.first), std::move(record.second));
+                }
+                return map;
+            }
+        };
+
+        template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+        struct StreamLoader<HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>> {
+            using Map = HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>;
+
+            static Map load(StreamReader &reader) {
+                Map map;
+                map.reserve((std::size_t) std::min(reader.count, MAX_STREAM_RESERVE));
+                for (std::uint64_t i = 0; i < reader.count; ++i) {
+                    auto record = reader.readRecord<KeyType, ValueType>();
+                    map.try_emplace(std::move(record.first), std::move(record.second));
+                }
+                return map;
+            }
+        };
+
+    }
+
+    // Writes every element of map to out, a block at a time.
+    template<typename Map>
+    void serialize(const Map &map, std::ostream &out, const SerializationOptions &options = SerializationOptions()) {
+        StreamWriter writer(out, map.getSize(), detail::IsSortedStream<Map>::value, options);
+
+        for (auto it = map.cbegin(); it != map.cend(); ++it) writer.writeRecord(it->first, it->second);
+
+        writer.finish();
+    }
+
+    // Reads a map written by serialize; the stream may come from a map of
+    // the other kind. A sorted stream loads into a TreeMap in O(n). Throws
+    // std::runtime_error on a truncated, corrupt or unreadable stream, and
+    // when a TreeMap stream is loaded into a TreeMap whose Compare orders
+    // the keys differently: the stream is read only once, so load it into a
+    // HashMap or a TreeMap with the writer's Compare instead.
+    template<typename Map>
+    Map deserialize(std::istream &in) {
+        StreamReader reader(in);
+        Map map = detail::StreamLoader<Map>::load(reader);
+        reader.finish();
+        return map;
+    }
+
+}
+
+#endif /* AISDI_MAPS_SERIALIZATION_H */
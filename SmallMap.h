@@ -0,0 +1,582 @@
+#ifndef AISDI_MAPS_SMALLMAP_H
+#define AISDI_MAPS_SMALLMAP_H
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "Config.h"
+#include "HashMap.h"
+#include "Hashing.h"
+#include "TreeMap.h"
+
+namespace aisdi {
+
+    namespace detail {
+
+        // How SmallMap orders its inline elements so that iterating matches the
+        // map it stands in for. compare returns < 0 when key goes before
+        // other, 0 when they are equal, > 0 to keep looking.
+        template<typename Map>
+        struct SmallMapOrder;
+
+        // insertion order; HashMap promises no order at all
+        template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+        struct SmallMapOrder<HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>> {
+            template<typename K>
+            static int compare(const HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator> &map, const K &key,
+                               const KeyType &other) {
+                return map.keyEqual(other, key) ? 0 : 1;
+            }
+        };
+
+        // sorted, so a miss stops at the first greater key
+        template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+        struct SmallMapOrder<TreeMap<KeyType, ValueType, Compare, Allocator>> {
+            template<typename K>
+            static int compare(const TreeMap<KeyType, ValueType, Compare, Allocator> &map, const K &key,
+                               const KeyType &other) {
+                if (map.compare(key, other)) return -1;
+                return map.compare(other, key) ? 1 : 0;
+            }
+        };
+
+    }
+
+    // Keeps up to N elements inline and moves them into a Map (a HashMap or
+    // TreeMap) only when an insertion needs room for one more. Tiny maps are
+    // then built, filled and destroyed without touching the heap: the inline
+    // elements are searched linearly, and the Map stays empty, which costs
+    // no allocation for either of them. Iterating follows the Map: sorted for
+    // TreeMap, insertion order for HashMap while inline.
+    //
+    // The inline elements never move. Their slots are tracked by a permutation
+    // in order[], whose first inlineCount entries are the live slots in
+    // iteration order and the rest the free ones, so inserting and removing
+    // shuffle bytes only. Once spilled the map stays spilled until clear(). Spilling
+    // invalidates every iterator and reference; after that the Map's own rules
+    // apply. While inline, iterators hold a position in order[], which every
+    // insertion and removal shifts, so either invalidates all iterators;
+    // references stay valid except to a removed element.
+    template<typename Map, std::size_t N = 8>
+    class SmallMap {
+    public:
+        using map_type = Map;
+        using key_type = typename Map::key_type;
+        using mapped_type = typename Map::mapped_type;
+        using value_type = typename Map::value_type;
+        using size_type = std::size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+
+        static_assert(N > 0 && N <= 255, "SmallMap keeps between 1 and 255 elements inline");
+
+        class ConstIterator;
+
+        class Iterator;
+
+        using iterator = Iterator;
+        using const_iterator = ConstIterator;
+
+        using Order = detail::SmallMapOrder<Map>;
+        using Slot = typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type;
+
+        Map large;
+        Slot slots[N];
+        unsigned char order[N];
+        size_type inlineCount;
+        bool spilled;
+
+        SmallMap(): large(), inlineCount(0), spilled(false) {
+            for (size_type i = 0; i < N; ++i) order[i] = (unsigned char) i;
+        }
+
+        ~SmallMap() {
+            destroyInline();
+        }
+
+        SmallMap(std::initializer_list<value_type> list): SmallMap() {
+            for (auto it = list.begin(); it != list.end(); ++it) {
+                insert_or_assign(it->first, it->second);
+            }
+        }
+
+        // Moves the inline elements one by one; a throwing move leaves both
+        // maps valid but not necessarily swapped.
+        void swapMap(SmallMap &a, SmallMap &b) {
+            std::swap(a.large, b.large);
+            std::swap(a.spilled, b.spilled);
+
+            size_type both = a.inlineCount < b.inlineCount ? a.inlineCount : b.inlineCount;
+            size_type longest = a.inlineCount < b.inlineCount ? b.inlineCount : a.inlineCount;
+
+            for (size_type p = 0; p < longest; ++p) {
+                value_type *x = a.slotAt(p);
+                value_type *y = b.slotAt(p);
+
+                if (p < both) {
+                    value_type temp(std::move(*x));
+                    x->~value_type();
+                    new (x) value_type(std::move(*y));
+                    y->~value_type();
+                    new (y) value_type(std::move(temp));
+                }
+                else if (p < a.inlineCount) {
+                    new (y) value_type(std::move(*x));
+                    x->~value_type();
+                }
+                else {
+                    new (x) value_type(std::move(*y));
+                    y->~value_type();
+                }
+            }
+
+            std::swap(a.inlineCount, b.inlineCount);
+        }
+
+        SmallMap(const SmallMap &other): large(other.large), inlineCount(0), spilled(other.spilled) {
+            for (size_type i = 0; i < N; ++i) order[i] = (unsigned char) i;
+
+            try {
+                for (; inlineCount < other.inlineCount; ++inlineCount)
+                    new (slotAt(inlineCount)) value_type(*other.slotAt(inlineCount));
+            }
+            catch (...) {
+                destroyInline();
+                throw;
+            }
+        }
+
+        SmallMap(SmallMap &&other): SmallMap() {
+            swapMap(*this, other);
+        }
+
+        SmallMap &operator=(SmallMap other) {
+            swapMap(*this, other);
+            return *this;
+        }
+
+        bool isEmpty() const {
+            return getSize() == 0;
+        }
+
+        size_type getSize() const {
+            return spilled ? large.getSize() : inlineCount;
+        }
+
+        bool isSpilled() const {
+            return spilled;
+        }
+
+        mapped_type &operator[](const key_type &key) {
+            return try_emplace(key).first->second;
+        }
+
+        mapped_type &operator[](key_type &&key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+            return emplaceUnique(key, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+            return emplaceUnique(std::move(key), std::forward<Args>(args)...);
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+            auto result = emplaceUnique(key, std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+            auto result = emplaceUnique(std::move(key), std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        // Builds the element in a free slot and gives the slot back on a hit.
+        // With every slot taken the map spills first, even if the key turns
+        // out to be there already.
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args &&... args) {
+            if (!spilled) {
+                if (inlineCount < N) {
+                    value_type *element = slotAt(inlineCount);
+                    new (element) value_type(std::forward<Args>(args)...);
+
+                    bool found;
+                    size_type position = inlinePosition(element->first, found);
+                    if (found) {
+                        element->~value_type();
+                        return std::make_pair(inlineIterator(position), false);
+                    }
+
+                    linkSlot(position);
+                    return std::make_pair(inlineIterator(position), true);
+                }
+
+                spill();
+            }
+
+            auto result = large.emplace(std::forward<Args>(args)...);
+            return std::make_pair(Iterator(ConstIterator(this, 0, result.first)), result.second);
+        }
+
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceUnique(K &&key, Args &&... args) {
+            if (!spilled) {
+                bool found;
+                size_type position = inlinePosition(key, found);
+                if (found) return std::make_pair(inlineIterator(position), false);
+
+                if (inlineCount < N) {
+                    new (slotAt(inlineCount)) value_type(std::piecewise_construct,
+                                                   std::forward_as_tuple(std::forward<K>(key)),
+                                                   std::forward_as_tuple(std::forward<Args>(args)...));
+                    linkSlot(position);
+                    return std::make_pair(inlineIterator(position), true);
+                }
+
+                spill();
+            }
+
+            auto result = large.try_emplace(std::forward<K>(key), std::forward<Args>(args)...);
+            return std::make_pair(Iterator(ConstIterator(this, 0, result.first)), result.second);
+        }
+
+        const mapped_type &valueOf(const key_type &key) const {
+            if (spilled) return large.valueOf(key);
+
+            bool found;
+            size_type position = inlinePosition(key, found);
+
+            if (!found) throw std::out_of_range("");
+
+            return slotAt(position)->second;
+        }
+
+        mapped_type &valueOf(const key_type &key) {
+            return const_cast<mapped_type &>(static_cast<const SmallMap *>(this)->valueOf(key));
+        }
+
+        const_iterator find(const key_type &key) const {
+            if (spilled) return ConstIterator(this, 0, large.find(key));
+
+            bool found;
+            size_type position = inlinePosition(key, found);
+            return found ? ConstIterator(this, position) : cend();
+        }
+
+        iterator find(const key_type &key) {
+            return Iterator(static_cast<const SmallMap *>(this)->find(key));
+        }
+
+        bool contains(const key_type &key) const {
+            if (spilled) return large.contains(key);
+
+            bool found;
+            inlinePosition(key, found);
+            return found;
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        void remove(const key_type &key) {
+            remove(find(key));
+        }
+
+        void remove(const const_iterator &it) {
+            if (it.map != this) throw std::out_of_range("");
+
+            if (spilled) {
+                large.remove(it.it);
+                return;
+            }
+
+            if (it.position >= inlineCount) throw std::out_of_range("");
+
+            unsigned char freed = order[it.position];
+            slotAt(it.position)->~value_type();
+
+            for (size_type p = it.position; p + 1 < inlineCount; ++p) order[p] = order[p + 1];
+            order[--inlineCount] = freed;
+        }
+
+        // Drops every element and goes back to inline storage.
+        void clear() {
+            destroyInline();
+            large.clear();
+            spilled = false;
+        }
+
+        bool operator==(const SmallMap &other) const {
+            if (getSize() != other.getSize()) return false;
+
+            for (auto it = cbegin(); it != cend(); ++it) {
+                auto it2 = other.find(it->first);
+                if (it2 == other.cend() || it->second != it2->second) return false;
+            }
+
+            return true;
+        }
+
+        bool operator!=(const SmallMap &other) const {
+            return !operator==(other);
+        }
+
+        iterator begin() {
+            return Iterator(cbegin());
+        }
+
+        iterator end() {
+            return Iterator(cend());
+        }
+
+        const_iterator cbegin() const {
+            return spilled ? ConstIterator(this, 0, large.cbegin()) : ConstIterator(this, 0);
+        }
+
+        const_iterator cend() const {
+            return spilled ? ConstIterator(this, 0, large.cend()) : ConstIterator(this, inlineCount);
+        }
+
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        const_iterator end() const {
+            return cend();
+        }
+
+        value_type *slotAt(size_type position) {
+            return reinterpret_cast<value_type *>(&slots[order[position]]);
+        }
+
+        const value_type *slotAt(size_type position) const {
+            return reinterpret_cast<const value_type *>(&slots[order[position]]);
+        }
+
+        // Linear search of the inline elements: the position of key, or the
+        // one it would be inserted at.
+        template<typename K>
+        size_type inlinePosition(const K &key, bool &found) const {
+            for (size_type p = 0; p < inlineCount; ++p) {
+                int side = Order::compare(large, key, slotAt(p)->first);
+
+                if (side <= 0) {
+                    found = side == 0;
+                    return p;
+                }
+            }
+
+            found = false;
+            return inlineCount;
+        }
+
+    private:
+        iterator inlineIterator(size_type position) {
+            return Iterator(ConstIterator(this, position));
+        }
+
+        // The element just built in slot order[inlineCount] takes its place at
+        // position.
+        void linkSlot(size_type position) {
+            unsigned char slot = order[inlineCount];
+
+            for (size_type p = inlineCount; p > position; --p) order[p] = order[p - 1];
+            order[position] = slot;
+            ++inlineCount;
+        }
+
+        void destroyInline() {
+            for (size_type p = 0; p < inlineCount; ++p) slotAt(p)->~value_type();
+
+            inlineCount = 0;
+        }
+
+        // Moves the inline elements into large. Elements whose move may throw
+        // are copied, and ones that were moved are moved back if large fails,
+        // so a failure leaves the map as it was.
+        void spill() {
+            size_type moved = 0;
+
+            try {
+                for (; moved < inlineCount; ++moved) large.emplace(std::move_if_noexcept(*slotAt(moved)));
+            }
+            catch (...) {
+                if (std::is_nothrow_move_constructible<value_type>::value) {
+                    for (size_type p = 0; p < moved; ++p) {
+                        value_type *element = slotAt(p);
+                        auto it = large.find(element->first);
+
+                        element->~value_type();
+                        new (element) value_type(std::move(*it));
+                    }
+                }
+
+                large.clear();
+                throw;
+            }
+
+            destroyInline();
+            spilled = true;
+        }
+    };
+
+    template<typename Map, std::size_t N>
+    class SmallMap<Map, N>::ConstIterator {
+    public:
+        using reference = typename SmallMap::const_reference;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename SmallMap::value_type;
+        using pointer = const typename SmallMap::value_type *;
+
+        const SmallMap *map;
+        // used while the map is inline
+        size_type position;
+        // used once it has spilled
+        typename Map::const_iterator it;
+
+        explicit ConstIterator(): map(nullptr), position(0), it() {}
+
+        ConstIterator(const SmallMap *map, size_type position): map(map), position(position), it() {}
+
+        ConstIterator(const SmallMap *map, size_type position, const typename Map::const_iterator &it)
+                : map(map), position(position), it(it) {}
+
+        ConstIterator(const ConstIterator &other): map(other.map), position(other.position), it(other.it) {}
+
+        ConstIterator &operator++() {
+            if (map->spilled) {
+                ++it;
+                return *this;
+            }
+
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (position >= map->inlineCount) throw std::out_of_range("");
+#endif
+
+            ++position;
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator result(*this);
+            this->operator++();
+            return result;
+        }
+
+        ConstIterator &operator--() {
+            if (map->spilled) {
+                --it;
+                return *this;
+            }
+
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (position == 0) throw std::out_of_range("");
+#endif
+
+            --position;
+            return *this;
+        }
+
+        ConstIterator operator--(int) {
+            ConstIterator result(*this);
+            this->operator--();
+            return result;
+        }
+
+        reference operator*() const {
+            if (map->spilled) return *it;
+
+#if AISDI_MAPS_CHECKED_ITERATORS
+            if (position >= map->inlineCount) throw std::out_of_range("");
+#endif
+
+            return *map->slotAt(position);
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        bool operator==(const ConstIterator &other) const {
+            if (map != other.map) return false;
+
+            return map == nullptr || (map->spilled ? it == other.it : position == other.position);
+        }
+
+        bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    template<typename Map, std::size_t N>
+    class SmallMap<Map, N>::Iterator : public SmallMap<Map, N>::ConstIterator {
+    public:
+        using reference = typename SmallMap::reference;
+        using pointer = typename SmallMap::value_type *;
+
+        explicit Iterator() {}
+
+        Iterator(const ConstIterator &other)
+                : ConstIterator(other) {}
+
+        Iterator &operator++() {
+            ConstIterator::operator++();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto result = *this;
+            ConstIterator::operator++();
+            return result;
+        }
+
+        Iterator &operator--() {
+            ConstIterator::operator--();
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            auto result = *this;
+            ConstIterator::operator--();
+            return result;
+        }
+
+        pointer operator->() const {
+            return &this->operator*();
+        }
+
+        reference operator*() const {
+            // ugly cast, yet reduces code duplication.
+            return const_cast<reference>(ConstIterator::operator*());
+        }
+    };
+
+    template<typename KeyType, typename ValueType, std::size_t N = 8,
+            typename Hash = FastHash<KeyType>, typename KeyEqual = std::equal_to<KeyType>>
+    using SmallHashMap = SmallMap<HashMap<KeyType, ValueType, Hash, KeyEqual>, N>;
+
+    template<typename KeyType, typename ValueType, std::size_t N = 8, typename Compare = std::less<KeyType>>
+    using SmallTreeMap = SmallMap<TreeMap<KeyType, ValueType, Compare>, N>;
+
+}
+
+#endif /* AISDI_MAPS_SMALLMAP_H */
@@ -0,0 +1,42 @@
+#ifndef AISDI_MAPS_TRANSPARENTLOOKUP_H
+#define AISDI_MAPS_TRANSPARENTLOOKUP_H
+
+#include <type_traits>
+
+namespace aisdi {
+
+    namespace detail {
+
+        template<typename...>
+        struct MakeVoid {
+            using type = void;
+        };
+
+        template<typename... Ts>
+        using VoidT = typename MakeVoid<Ts...>::type;
+
+        template<typename T, typename = void>
+        struct IsTransparent : std::false_type {};
+
+        template<typename T>
+        struct IsTransparent<T, VoidT<typename T::is_transparent>> : std::true_type {};
+
+        template<typename... Functors>
+        struct AllTransparent : std::true_type {};
+
+        template<typename Functor, typename... Rest>
+        struct AllTransparent<Functor, Rest...>
+                : std::integral_constant<bool, IsTransparent<Functor>::value && AllTransparent<Rest...>::value> {};
+
+        // Enables a heterogeneous lookup overload for K when every hash/compare
+        // functor declares is_transparent. K must not convert to Excluded (the
+        // map's const_iterator), so remove(it) keeps picking the iterator overload.
+        template<typename K, typename Excluded, typename... Functors>
+        using EnableTransparent = typename std::enable_if<
+                AllTransparent<Functors...>::value && !std::is_convertible<const K &, Excluded>::value>::type;
+
+    }
+
+}
+
+#endif /* AISDI_MAPS_TRANSPARENTLOOKUP_H */
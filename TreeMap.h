@@ -1,14 +1,28 @@
 #ifndef AISDI_MAPS_TREEMAP_H
 #define AISDI_MAPS_TREEMAP_H
 
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <initializer_list>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#include "Config.h"
+#include "MapStats.h"
+#include "PoolAllocator.h"
+#include "TransparentLookup.h"
 
 namespace aisdi {
 
-    template<typename KeyType, typename ValueType>
+    template<typename KeyType, typename ValueType, typename Compare = std::less<KeyType>,
+            typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
     class TreeMap {
     public:
         using key_type = KeyType;
@@ -17,6 +31,8 @@ namespace aisdi {
         using size_type = std::size_t;
         using reference = value_type &;
         using const_reference = const value_type &;
+        using key_compare = Compare;
+        using allocator_type = Allocator;
 
         class ConstIterator;
 
@@ -27,10 +43,32 @@ namespace aisdi {
 
         class Node;
 
+        using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+        using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+        static const size_type BATCH_SIZE = 16;
+
         Node *root;
         int length;
-
-        TreeMap() {
+        Compare compare;
+        NodeAllocator nodeAllocator;
+        // see setHeightLimit; 0 when off
+        float heightLimit;
+        bool rebalanceOnLimit;
+        size_type heightLimitHits;
+        // insertions the monitor still lets pass before it may rebuild again
+        size_type rebalanceCooldown;
+#if AISDI_MAPS_ENABLE_STATS
+        mutable detail::StatsRecorder statsRecorder;
+#endif
+
+        TreeMap(): TreeMap(Compare(), Allocator()) {}
+
+        explicit TreeMap(const Allocator &allocator): TreeMap(Compare(), allocator) {}
+
+        explicit TreeMap(const Compare &compare, const Allocator &allocator = Allocator())
+                : compare(compare), nodeAllocator(allocator), heightLimit(0.0f), rebalanceOnLimit(false),
+                  heightLimitHits(0), rebalanceCooldown(0) {
             root = nullptr;
             length = 0;
         }
@@ -38,27 +76,50 @@ namespace aisdi {
         TreeMap(std::initializer_list<value_type> list):TreeMap() {
 
             for (auto it = list.begin(); it != list.end(); ++it) {
-                this->operator[](it->first) = it->second;
+                insert_or_assign(it->first, it->second);
             }
         }
 
-        TreeMap(const TreeMap &other):TreeMap() {
+        // Clones the source node by node, colours included, in one pass.
+        TreeMap(const TreeMap &other)
+                : TreeMap(other.compare,
+                          Allocator(NodeTraits::select_on_container_copy_construction(other.nodeAllocator))) {
 
-            for (auto it = other.cbegin(); it != other.cend(); ++it){
-                this->operator[](it->first) = it->second;
-            }
+            if (other.root != nullptr) root = cloneSubtree(other.root, nullptr);
+            length = other.length;
+            heightLimit = other.heightLimit;
+            rebalanceOnLimit = other.rebalanceOnLimit;
+        }
+
+        // Builds a height-balanced map in O(n) from elements whose keys are
+        // strictly increasing; throws std::invalid_argument otherwise.
+        template<typename ForwardIt>
+        static TreeMap fromSorted(ForwardIt first, ForwardIt last) {
+            return fromSortedN(first, (size_type) std::distance(first, last));
         }
 
-        void swapTree(TreeMap<KeyType, ValueType> &a, TreeMap<KeyType, ValueType> &b){
+        // Same as fromSorted, for count elements read once from an input iterator.
+        template<typename InputIt>
+        static TreeMap fromSortedN(InputIt first, size_type count) {
+            TreeMap map;
+            map.buildSorted(first, count);
+            return map;
+        }
+
+        void swapTree(TreeMap &a, TreeMap &b){
             std::swap(a.length, b.length);
             std::swap(a.root, b.root);
+            std::swap(a.compare, b.compare);
+            std::swap(a.nodeAllocator, b.nodeAllocator);
+            std::swap(a.heightLimit, b.heightLimit);
+            std::swap(a.rebalanceOnLimit, b.rebalanceOnLimit);
+            std::swap(a.heightLimitHits, b.heightLimitHits);
+            std::swap(a.rebalanceCooldown, b.rebalanceCooldown);
+            AISDI_MAPS_STAT(a.statsRecorder.swap(b.statsRecorder));
         }
 
         ~TreeMap(){
-            int size = length;
-            for (int i = 0; i < size; ++i){
-                remove(root);
-            }
+            destroyNodes();
         }
 
         TreeMap(TreeMap &&other): TreeMap() {
@@ -75,22 +136,103 @@ namespace aisdi {
         }
 
         mapped_type &operator[](const key_type &key) {
+            return try_emplace(key).first->second;
+        }
+
+        mapped_type &operator[](key_type &&key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        // Builds the element from args only when key is missing; on a hit
+        // neither key nor args are touched.
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+            return emplaceUnique(key, std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+            return emplaceUnique(std::move(key), std::forward<Args>(args)...);
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+            auto result = emplaceUnique(key, std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+            auto result = emplaceUnique(std::move(key), std::forward<M>(obj));
+            if (!result.second) result.first->second = std::forward<M>(obj);
+
+            return result;
+        }
+
+        // The key is only known once the element is built, so unlike
+        // try_emplace this constructs a node up front and drops it on a hit.
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args &&... args) {
+            Node * newNode = createNode(nullptr, std::forward<Args>(args)...);
+            Node * temp = root;
+            Node * parent = nullptr;
+            AISDI_MAPS_STAT(std::uint64_t probes = 0);
+
+            while(temp != nullptr)
+            {
+                parent = temp;
+                AISDI_MAPS_STAT(++probes);
+                if (compare(newNode->getKey(), temp->getKey())) temp = temp->getLeftChild();
+                else if (compare(temp->getKey(), newNode->getKey())) temp = temp->getRightChild();
+                else {
+                    AISDI_MAPS_STAT(statsRecorder.treeSearch(probes, probes));
+                    destroyNode(newNode);
+                    return std::make_pair(Iterator(ConstIterator(temp, this)), false);
+                }
+            }
+
+            AISDI_MAPS_STAT(statsRecorder.treeSearch(probes, probes + 1));
+            newNode->setParent(parent);
+            linkNode(newNode);
+            return std::make_pair(Iterator(ConstIterator(newNode, this)), true);
+        }
+
+        template<typename K, typename... Args>
+        std::pair<iterator, bool> emplaceUnique(K &&key, Args &&... args) {
             Node * temp = root;
             Node * parent = nullptr;
+            AISDI_MAPS_STAT(std::uint64_t probes = 0);
 
             while(temp != nullptr)
             {
                 parent = temp;
-                if (key == temp->getValueType().first) return temp->getValueType().second;
-                else if(key > temp->getValueType().first) temp = temp->getRightChild();
-                else if(key < temp->getValueType().first) temp = temp->getLeftChild();
+                AISDI_MAPS_STAT(++probes);
+                if (compare(key, temp->getKey())) temp = temp->getLeftChild();
+                else if (compare(temp->getKey(), key)) temp = temp->getRightChild();
+                else {
+                    AISDI_MAPS_STAT(statsRecorder.treeSearch(probes, probes));
+                    return std::make_pair(Iterator(ConstIterator(temp, this)), false);
+                }
             }
 
-            Node * newNode = new Node(key, mapped_type{}, parent);
+            AISDI_MAPS_STAT(statsRecorder.treeSearch(probes, probes + 1));
+
+            Node * newNode = createNode(parent, std::piecewise_construct,
+                                        std::forward_as_tuple(std::forward<K>(key)),
+                                        std::forward_as_tuple(std::forward<Args>(args)...));
+            linkNode(newNode);
+            return std::make_pair(Iterator(ConstIterator(newNode, this)), true);
+        }
+
+        // Hangs a new node under the parent it was created with and rebalances.
+        void linkNode(Node *newNode) {
+            Node *parent = newNode->getParent();
 
             if(parent != nullptr)
             {
-                if(key < parent->getValueType().first)
+                if(compare(newNode->getKey(), parent->getKey()))
                 {
                     parent->setLeftChild(newNode);
                 }
@@ -105,7 +247,26 @@ namespace aisdi {
             }
             ++length;
 
-            return newNode->getValueType().second;
+            size_type depth = 1;
+            for (Node *ancestor = parent; ancestor != nullptr; ancestor = ancestor->getParent(), ++depth)
+                ancestor->setSubtreeSize(ancestor->getSubtreeSize() + 1);
+
+            insertFixup(newNode);
+
+            bool tooDeep = heightLimit > 0.0f && depth > heightLimit * std::log2((double) length + 1);
+            if (tooDeep) ++heightLimitHits;
+
+            if (rebalanceCooldown > 0) {
+                --rebalanceCooldown;
+            }
+            else if (tooDeep && rebalanceOnLimit) {
+                // the tree is valid either way, so running out of memory
+                // only skips the rebuild
+                try {
+                    rebalance();
+                    rebalanceCooldown = (size_type) length;
+                } catch (const std::bad_alloc &) {}
+            }
         }
 
         const mapped_type &valueOf(const key_type &key) const {
@@ -116,53 +277,580 @@ namespace aisdi {
             return findNode(key)->getValueType().second;
         }
 
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        const mapped_type &valueOf(const K &key) const {
+            return findNode(key)->getValueType().second;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        mapped_type &valueOf(const K &key) {
+            return findNode(key)->getValueType().second;
+        }
+
         const_iterator find(const key_type &key) const {
+            return ConstIterator(lookup(key), this);
+        }
+
+        iterator find(const key_type &key) {
+            return Iterator(ConstIterator(lookup(key), this));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        const_iterator find(const K &key) const {
+            return ConstIterator(lookup(key), this);
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        iterator find(const K &key) {
+            return Iterator(ConstIterator(lookup(key), this));
+        }
+
+        bool contains(const key_type &key) const {
+            return lookup(key) != nullptr;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        bool contains(const K &key) const {
+            return lookup(key) != nullptr;
+        }
+
+        size_type count(const key_type &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        size_type count(const K &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        // Batch counterparts of find and try_emplace. Keys go through in
+        // groups of BATCH_SIZE whose searches run down the tree side by side,
+        // see descendMany.
+
+        // Writes one iterator per key in keys (a forward range of key_type) to
+        // out, end() for a missing key; returns the advanced out.
+        template<typename KeyRange, typename OutputIt>
+        OutputIt findMany(const KeyRange &keys, OutputIt out) const {
+            forEachFound(keys, [this, &out](Node *node) { *out++ = ConstIterator(node, this); });
+            return out;
+        }
+
+        template<typename KeyRange, typename OutputIt>
+        OutputIt findMany(const KeyRange &keys, OutputIt out) {
+            forEachFound(keys, [this, &out](Node *node) { *out++ = Iterator(ConstIterator(node, this)); });
+            return out;
+        }
+
+        // Adds every element of elements (a forward range of key/value pairs)
+        // whose key is missing, like try_emplace; returns how many were added.
+        // Keys already present are settled by the batched walk alone, and the
+        // others are inserted along paths it has just brought into cache.
+        template<typename Range>
+        size_type insertMany(const Range &elements) {
+            using K = typename std::decay<decltype(std::begin(elements)->first)>::type;
+
+            const K *keys[BATCH_SIZE];
+            Node *found[BATCH_SIZE];
+            size_type inserted = 0;
+            auto it = std::begin(elements);
+            auto last = std::end(elements);
+
+            while (it != last) {
+                auto batch = it;
+                size_type count = 0;
+
+                for (; count < BATCH_SIZE && it != last; ++count, ++it) keys[count] = std::addressof(it->first);
+
+                descendMany(keys, count, found);
+
+                for (size_type i = 0; i < count; ++i, ++batch) {
+                    if (found[i] == nullptr && emplaceUnique(batch->first, batch->second).second) ++inserted;
+                }
+            }
+
+            return inserted;
+        }
+
+        // Ordered navigation. Each call is one walk down the tree, and moving
+        // on from the iterator it returns costs amortized O(1) per step, so a
+        // scan over k elements costs O(log n + k).
+
+        // First element whose key is not less than key.
+        const_iterator lower_bound(const key_type &key) const {
+            return ConstIterator(lowerBoundNode(key), this);
+        }
+
+        iterator lower_bound(const key_type &key) {
+            return Iterator(ConstIterator(lowerBoundNode(key), this));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        const_iterator lower_bound(const K &key) const {
+            return ConstIterator(lowerBoundNode(key), this);
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        iterator lower_bound(const K &key) {
+            return Iterator(ConstIterator(lowerBoundNode(key), this));
+        }
+
+        // First element whose key is greater than key.
+        const_iterator upper_bound(const key_type &key) const {
+            return ConstIterator(upperBoundNode(key), this);
+        }
+
+        iterator upper_bound(const key_type &key) {
+            return Iterator(ConstIterator(upperBoundNode(key), this));
+        }
 
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        const_iterator upper_bound(const K &key) const {
+            return ConstIterator(upperBoundNode(key), this);
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        iterator upper_bound(const K &key) {
+            return Iterator(ConstIterator(upperBoundNode(key), this));
+        }
+
+        std::pair<const_iterator, const_iterator> equal_range(const key_type &key) const {
+            return std::make_pair(lower_bound(key), upper_bound(key));
+        }
+
+        std::pair<iterator, iterator> equal_range(const key_type &key) {
+            return std::make_pair(lower_bound(key), upper_bound(key));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        std::pair<const_iterator, const_iterator> equal_range(const K &key) const {
+            return std::make_pair(lower_bound(key), upper_bound(key));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        std::pair<iterator, iterator> equal_range(const K &key) {
+            return std::make_pair(lower_bound(key), upper_bound(key));
+        }
+
+        // Last element whose key is not greater than key, or end().
+        const_iterator floor(const key_type &key) const {
+            return ConstIterator(floorNode(key), this);
+        }
+
+        iterator floor(const key_type &key) {
+            return Iterator(ConstIterator(floorNode(key), this));
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        const_iterator floor(const K &key) const {
+            return ConstIterator(floorNode(key), this);
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        iterator floor(const K &key) {
+            return Iterator(ConstIterator(floorNode(key), this));
+        }
+
+        // First element whose key is not less than key, or end(); the same
+        // element lower_bound finds.
+        const_iterator ceiling(const key_type &key) const {
+            return lower_bound(key);
+        }
+
+        iterator ceiling(const key_type &key) {
+            return lower_bound(key);
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        const_iterator ceiling(const K &key) const {
+            return lower_bound(key);
+        }
+
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        iterator ceiling(const K &key) {
+            return lower_bound(key);
+        }
+
+        // Pair of iterators usable in a range-based for. Nothing is copied;
+        // the elements are visited as the loop advances.
+        template<typename It>
+        struct Range {
+            It first;
+            It last;
+
+            It begin() const {
+                return first;
+            }
+
+            It end() const {
+                return last;
+            }
+
+            bool isEmpty() const {
+                return first == last;
+            }
+        };
+
+        // Elements with keys in [low, high); empty when high is not greater
+        // than low.
+        Range<const_iterator> range(const key_type &low, const key_type &high) const {
+            const_iterator first = lower_bound(low);
+            return Range<const_iterator>{first, compare(low, high) ? lower_bound(high) : first};
+        }
+
+        Range<iterator> range(const key_type &low, const key_type &high) {
+            iterator first = lower_bound(low);
+            return Range<iterator>{first, compare(low, high) ? lower_bound(high) : first};
+        }
+
+        // Counters of the work done since construction or resetStats(); all
+        // zero unless built with AISDI_MAPS_ENABLE_STATS.
+        MapStats stats() const {
+#if AISDI_MAPS_ENABLE_STATS
+            return statsRecorder.snapshot();
+#else
+            return MapStats();
+#endif
+        }
+
+        void resetStats() {
+            AISDI_MAPS_STAT(statsRecorder.reset());
+        }
+
+        // A no-op unless built with AISDI_MAPS_ENABLE_STATS.
+        void setStatsCallback(StatsCallback callback) {
+#if AISDI_MAPS_ENABLE_STATS
+            statsRecorder.callback = std::move(callback);
+#else
+            (void) callback;
+#endif
+        }
+
+        // Shape of the tree right now. Depths count the root as 0, and
+        // height is the number of levels, so an empty tree has height 0.
+        struct ShapeReport {
+            size_type size;
+            size_type height;
+            size_type maxDepth;
+            double averageDepth;
+            // height of a perfectly balanced tree of the same size
+            size_type minimalHeight;
+            // depthHistogram[d] nodes sit at depth d
+            std::vector<size_type> depthHistogram;
+        };
+
+        // One walk over every node along parent links, O(n) time and no
+        // stack beyond the histogram.
+        ShapeReport shapeReport() const {
+            ShapeReport report;
+            report.size = (size_type) length;
+            report.minimalHeight = 0;
+            while (((size_type) 1 << report.minimalHeight) <= report.size) ++report.minimalHeight;
+
+            size_type depthSum = 0;
+            size_type depth = 0;
+            Node *node = root;
+
+            while (node != nullptr) {
+                if (depth >= report.depthHistogram.size()) report.depthHistogram.resize(depth + 1, 0);
+                ++report.depthHistogram[depth];
+                depthSum += depth;
+
+                if (node->getLeftChild() != nullptr) {
+                    node = node->getLeftChild();
+                    ++depth;
+                    continue;
+                }
+                if (node->getRightChild() != nullptr) {
+                    node = node->getRightChild();
+                    ++depth;
+                    continue;
+                }
+
+                // climb to the nearest ancestor whose right subtree is still unvisited
+                for (;;) {
+                    Node *parent = node->getParent();
+                    if (parent == nullptr) {
+                        node = nullptr;
+                        break;
+                    }
+
+                    if (node == parent->getLeftChild() && parent->getRightChild() != nullptr) {
+                        node = parent->getRightChild();
+                        break;
+                    }
+
+                    node = parent;
+                    --depth;
+                }
+            }
+
+            report.height = report.depthHistogram.size();
+            report.maxDepth = report.height == 0 ? 0 : report.height - 1;
+            report.averageDepth = length == 0 ? 0.0 : (double) depthSum / length;
+            return report;
+        }
+
+        // Watches every insertion: when the new node lands deeper than
+        // factor * log2(n + 1) levels the hit is counted and, if rebalance is
+        // set, the whole tree is rebuilt with rebalance(). A red-black tree is
+        // never taller than 2 * log2(n + 1), so factors of 2 and more never
+        // fire. Near 1 even a perfectly balanced tree keeps hitting the limit,
+        // so after rebuilding n elements the monitor waits for n more
+        // insertions before it rebuilds again: the limit is a target rather
+        // than a bound, and rebuilds cost O(1) amortised per insertion for
+        // any factor. 0 turns the monitor off; anything else below 1 throws
+        // std::out_of_range.
+        void setHeightLimit(float factor, bool rebalance = true) {
+            if (factor != 0.0f && !(factor >= 1.0f)) throw std::out_of_range("");
+
+            heightLimit = factor;
+            rebalanceOnLimit = rebalance;
+            rebalanceCooldown = 0;
+        }
+
+        float getHeightLimit() const {
+            return heightLimit;
+        }
+
+        // How many insertions went past the height limit so far.
+        size_type getHeightLimitHits() const {
+            return heightLimitHits;
+        }
+
+        // Relinks the existing nodes into a perfectly balanced tree in O(n);
+        // no element is copied or moved, so iterators and references stay
+        // valid. Needs one pointer per element of scratch space.
+        void rebalance() {
+            if (root == nullptr) return;
+
+            std::vector<Node *> nodes;
+            nodes.reserve((size_type) length);
+            for (auto it = cbegin(); it != cend(); ++it) nodes.push_back(it.node);
+
+            root = linkBalanced(nodes.data(), nodes.size(), 0, balancedRedDepth(nodes.size()));
+            root->setParent(nullptr);
+        }
+
+        // Order statistics. Every node knows the size of its subtree, so these
+        // are single walks down (or up) the tree.
+
+        // Number of keys less than key.
+        size_type rank(const key_type &key) const {
             Node *temp = root;
+            size_type result = 0;
 
             while (temp != nullptr) {
-                if (temp->getKey() < key) {
+                if (compare(temp->getKey(), key)) {
+                    result += subtreeSize(temp->getLeftChild()) + 1;
                     temp = temp->getRightChild();
-                } else if (temp->getKey() > key) {
+                } else {
                     temp = temp->getLeftChild();
+                }
+            }
+
+            return result;
+        }
+
+        // Element with index i in key order; throws std::out_of_range if
+        // there are not that many.
+        const value_type &select(size_type i) const {
+            if (i >= getSize()) throw std::out_of_range("");
+
+            return selectNode(i)->getValueType();
+        }
+
+        // Iterator to the element with index i in key order, or end().
+        const_iterator nth(size_type i) const {
+            return ConstIterator(selectNode(i), this);
+        }
+
+        iterator nth(size_type i) {
+            return Iterator(ConstIterator(selectNode(i), this));
+        }
+
+        // Number of keys in [low, high), counting the same elements range() visits.
+        size_type countInRange(const key_type &low, const key_type &high) const {
+            if (!compare(low, high)) return 0;
+
+            return rank(high) - rank(low);
+        }
+
+        Node *selectNode(size_type i) const {
+            Node *temp = root;
+
+            while (temp != nullptr) {
+                size_type leftSize = subtreeSize(temp->getLeftChild());
+
+                if (i < leftSize) {
+                    temp = temp->getLeftChild();
+                } else if (i > leftSize) {
+                    i -= leftSize + 1;
+                    temp = temp->getRightChild();
                 } else {
-                    return ConstIterator(temp, this);
+                    return temp;
                 }
             }
 
-            return cend();
+            return nullptr;
+        }
+
+        // Index of node in key order; getSize() for end().
+        size_type indexOf(Node *node) const {
+            if (node == nullptr) return getSize();
+
+            size_type index = subtreeSize(node->getLeftChild());
+
+            for (Node *parent = node->getParent(); parent != nullptr; node = parent, parent = parent->getParent()) {
+                if (parent->getRightChild() == node) index += subtreeSize(parent->getLeftChild()) + 1;
+            }
+
+            return index;
         }
 
-        Node *findNode(const key_type &key) const {
+        template<typename K>
+        Node *lowerBoundNode(const K &key) const {
             Node *temp = root;
+            Node *result = nullptr;
 
             while (temp != nullptr) {
-                if (temp->getKey() < key) {
+                if (compare(temp->getKey(), key)) {
                     temp = temp->getRightChild();
-                } else if (temp->getKey() > key) {
+                } else {
+                    result = temp;
+                    temp = temp->getLeftChild();
+                }
+            }
+
+            return result;
+        }
+
+        template<typename K>
+        Node *upperBoundNode(const K &key) const {
+            Node *temp = root;
+            Node *result = nullptr;
+
+            while (temp != nullptr) {
+                if (compare(key, temp->getKey())) {
+                    result = temp;
                     temp = temp->getLeftChild();
                 } else {
-                    return temp;
+                    temp = temp->getRightChild();
                 }
             }
 
-            throw std::out_of_range("");
+            return result;
         }
 
-        iterator find(const key_type &key) {
+        template<typename K>
+        Node *floorNode(const K &key) const {
             Node *temp = root;
+            Node *result = nullptr;
 
             while (temp != nullptr) {
-                if (temp->getKey() < key) {
+                if (compare(key, temp->getKey())) {
+                    temp = temp->getLeftChild();
+                } else {
+                    result = temp;
                     temp = temp->getRightChild();
-                } else if (temp->getKey() > key) {
+                }
+            }
+
+            return result;
+        }
+
+        // Shared by the key_type and heterogeneous overloads; K is only ever
+        // something other than key_type when Compare is transparent.
+        template<typename K>
+        Node *lookup(const K &key) const {
+            Node *temp = root;
+            AISDI_MAPS_STAT(std::uint64_t probes = 0);
+
+            while (temp != nullptr) {
+                AISDI_MAPS_STAT(++probes);
+                if (compare(temp->getKey(), key)) {
+                    temp = temp->getRightChild();
+                } else if (compare(key, temp->getKey())) {
                     temp = temp->getLeftChild();
                 } else {
-                    return Iterator(ConstIterator(temp, this));
+                    AISDI_MAPS_STAT(statsRecorder.treeSearch(probes, probes));
+                    return temp;
+                }
+            }
+
+            AISDI_MAPS_STAT(statsRecorder.treeSearch(probes, probes));
+            return nullptr;
+        }
+
+        // Runs count lookups at once, one tree level per round: each search
+        // takes a step and prefetches the child it moves to, so the misses of
+        // a round overlap and the batch waits about once per level instead of
+        // once per level and key. found[i] is the node of *keys[i] or nullptr.
+        template<typename K>
+        void descendMany(const K *const *keys, size_type count, Node **found) const {
+            Node *cursors[BATCH_SIZE];
+            size_type active = count;
+            AISDI_MAPS_STAT(std::uint64_t probes[BATCH_SIZE] = {});
+
+            for (size_type i = 0; i < count; ++i) {
+                cursors[i] = root;
+                found[i] = nullptr;
+            }
+
+            while (active > 0) {
+                active = 0;
+
+                for (size_type i = 0; i < count; ++i) {
+                    Node *temp = cursors[i];
+                    if (temp == nullptr) continue;
+
+                    AISDI_MAPS_STAT(++probes[i]);
+                    if (compare(temp->getKey(), *keys[i])) {
+                        temp = temp->getRightChild();
+                    } else if (compare(*keys[i], temp->getKey())) {
+                        temp = temp->getLeftChild();
+                    } else {
+                        found[i] = temp;
+                        temp = nullptr;
+                    }
+
+                    cursors[i] = temp;
+                    if (temp != nullptr) {
+                        AISDI_MAPS_PREFETCH(temp);
+                        ++active;
+                    }
                 }
             }
 
-            return end();
+            AISDI_MAPS_STAT(for (size_type i = 0; i < count; ++i) statsRecorder.treeSearch(probes[i], probes[i]));
+        }
+
+        template<typename KeyRange, typename Visit>
+        void forEachFound(const KeyRange &keys, Visit visit) const {
+            using K = typename std::decay<decltype(*std::begin(keys))>::type;
+
+            const K *batch[BATCH_SIZE];
+            Node *found[BATCH_SIZE];
+            auto it = std::begin(keys);
+            auto last = std::end(keys);
+
+            while (it != last) {
+                size_type count = 0;
+
+                for (; count < BATCH_SIZE && it != last; ++count, ++it) batch[count] = std::addressof(*it);
+
+                descendMany(batch, count, found);
+
+                for (size_type i = 0; i < count; ++i) visit(found[i]);
+            }
+        }
+
+        template<typename K>
+        Node *findNode(const K &key) const {
+            Node *temp = lookup(key);
+
+            if (temp == nullptr) throw std::out_of_range("");
+
+            return temp;
         }
 
         void remove(const key_type &key) {
@@ -170,64 +858,238 @@ namespace aisdi {
             remove(temp);
         }
 
+        template<typename K, typename = detail::EnableTransparent<K, const_iterator, Compare>>
+        void remove(const K &key) {
+            remove(findNode(key));
+        }
+
         void remove(Node * temp){
             if (temp == nullptr || root == nullptr) throw std::out_of_range("");
 
-            Node *parent = temp->getParent();
-            Node *leftChild = temp->getLeftChild();
-            Node *rightChild = temp->getRightChild();
+            Node *child;
+            Node *childParent;
+            bool removedRed = temp->isRed();
 
-            // if node has no children
-            if (!temp->hasChildren()) {
-                if (parent == nullptr) root = nullptr;
-                else
-                    if (temp == parent->getLeftChild())
-                        parent->setLeftChild(nullptr);
-                    else
-                        parent->setRightChild(nullptr);
-            } // has Left child only
-            else if (leftChild != nullptr && rightChild == nullptr) {
-                if (parent == nullptr) {
-                    root = leftChild;
-                    root->setParent(nullptr);
-                }
-                else {
-                    if (temp == parent->getLeftChild())
-                        parent->setLeftChild(leftChild);
-                    else
-                        parent->setRightChild(leftChild);
+            // the node leaving the tree is temp itself, or the successor when
+            // temp has two children; either way everything above it shrinks
+            Node *unlinked = temp;
+            if (temp->getLeftChild() != nullptr && temp->getRightChild() != nullptr) {
+                unlinked = temp->getRightChild();
+                while (unlinked->getLeftChild() != nullptr) unlinked = unlinked->getLeftChild();
+            }
 
-                    leftChild->setParent(parent);
-                }
-            } // has Right child only
-            else if (rightChild != nullptr && leftChild == nullptr) {
-                if (parent == nullptr) {
-                    root = rightChild;
-                    root->setParent(nullptr);
+            for (Node *ancestor = unlinked->getParent(); ancestor != nullptr; ancestor = ancestor->getParent())
+                ancestor->setSubtreeSize(ancestor->getSubtreeSize() - 1);
+
+            if (temp->getLeftChild() == nullptr) {
+                child = temp->getRightChild();
+                childParent = temp->getParent();
+                replaceChild(temp, child);
+            }
+            else if (temp->getRightChild() == nullptr) {
+                child = temp->getLeftChild();
+                childParent = temp->getParent();
+                replaceChild(temp, child);
+            }
+            else {
+                // relink the successor in place of temp instead of copying its
+                // value, so iterators to other nodes stay valid
+                Node * successor = unlinked;
+
+                removedRed = successor->isRed();
+                child = successor->getRightChild();
+
+                if (successor->getParent() == temp) {
+                    childParent = successor;
                 }
                 else {
-                    if (temp == parent->getLeftChild())
-                        parent->setLeftChild(rightChild);
-                     else
-                        parent->setRightChild(rightChild);
-
-                    rightChild->setParent(parent);
+                    childParent = successor->getParent();
+                    replaceChild(successor, child);
+                    successor->setRightChild(temp->getRightChild());
+                    successor->getRightChild()->setParent(successor);
                 }
-            } else {
 
-                Node * successor = rightChild;
+                replaceChild(temp, successor);
+                successor->setLeftChild(temp->getLeftChild());
+                successor->getLeftChild()->setParent(successor);
+                successor->setRed(temp->isRed());
+                successor->setSubtreeSize(temp->getSubtreeSize());
+            }
+
+            --length;
+            destroyNode(temp);
+
+            if (!removedRed) removeFixup(child, childParent);
+        }
+
+        static bool isRed(Node *node) {
+            return node != nullptr && node->isRed();
+        }
+
+        static size_type subtreeSize(Node *node) {
+            return node == nullptr ? 0 : node->getSubtreeSize();
+        }
+
+        // puts newChild where oldChild hangs under its parent (or at the root)
+        void replaceChild(Node *oldChild, Node *newChild) {
+            Node *parent = oldChild->getParent();
+
+            if (parent == nullptr) root = newChild;
+            else if (oldChild == parent->getLeftChild()) parent->setLeftChild(newChild);
+            else parent->setRightChild(newChild);
+
+            if (newChild != nullptr) newChild->setParent(parent);
+        }
 
-                while(successor->getLeftChild() != nullptr)
-                    successor=successor->getLeftChild();
+        void rotateLeft(Node *node) {
+            AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.rotations));
+            Node *pivot = node->getRightChild();
 
-                temp->setValue(successor->getValueType());
+            node->setRightChild(pivot->getLeftChild());
+            if (pivot->getLeftChild() != nullptr) pivot->getLeftChild()->setParent(node);
 
-                remove(successor);
-                return;
+            replaceChild(node, pivot);
+            pivot->setLeftChild(node);
+            node->setParent(pivot);
+
+            pivot->setSubtreeSize(node->getSubtreeSize());
+            node->setSubtreeSize(subtreeSize(node->getLeftChild()) + subtreeSize(node->getRightChild()) + 1);
+        }
+
+        void rotateRight(Node *node) {
+            AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.rotations));
+            Node *pivot = node->getLeftChild();
+
+            node->setLeftChild(pivot->getRightChild());
+            if (pivot->getRightChild() != nullptr) pivot->getRightChild()->setParent(node);
+
+            replaceChild(node, pivot);
+            pivot->setRightChild(node);
+            node->setParent(pivot);
+
+            pivot->setSubtreeSize(node->getSubtreeSize());
+            node->setSubtreeSize(subtreeSize(node->getLeftChild()) + subtreeSize(node->getRightChild()) + 1);
+        }
+
+        // restores the red-black invariants after node was linked in as a red leaf
+        void insertFixup(Node *node) {
+            while (node != root && isRed(node->getParent())) {
+                Node *parent = node->getParent();
+                Node *grandparent = parent->getParent();
+
+                if (parent == grandparent->getLeftChild()) {
+                    Node *uncle = grandparent->getRightChild();
+
+                    if (isRed(uncle)) {
+                        parent->setRed(false);
+                        uncle->setRed(false);
+                        grandparent->setRed(true);
+                        node = grandparent;
+                        continue;
+                    }
+
+                    if (node == parent->getRightChild()) {
+                        node = parent;
+                        rotateLeft(node);
+                        parent = node->getParent();
+                    }
+
+                    parent->setRed(false);
+                    grandparent->setRed(true);
+                    rotateRight(grandparent);
+                }
+                else {
+                    Node *uncle = grandparent->getLeftChild();
+
+                    if (isRed(uncle)) {
+                        parent->setRed(false);
+                        uncle->setRed(false);
+                        grandparent->setRed(true);
+                        node = grandparent;
+                        continue;
+                    }
+
+                    if (node == parent->getLeftChild()) {
+                        node = parent;
+                        rotateRight(node);
+                        parent = node->getParent();
+                    }
+
+                    parent->setRed(false);
+                    grandparent->setRed(true);
+                    rotateLeft(grandparent);
+                }
             }
 
-            --length;
-            delete temp;
+            root->setRed(false);
+        }
+
+        // node (possibly null) carries an extra black after a black node was unlinked
+        void removeFixup(Node *node, Node *parent) {
+            while (node != root && !isRed(node)) {
+                if (node == parent->getLeftChild()) {
+                    Node *sibling = parent->getRightChild();
+
+                    if (isRed(sibling)) {
+                        sibling->setRed(false);
+                        parent->setRed(true);
+                        rotateLeft(parent);
+                        sibling = parent->getRightChild();
+                    }
+
+                    if (!isRed(sibling->getLeftChild()) && !isRed(sibling->getRightChild())) {
+                        sibling->setRed(true);
+                        node = parent;
+                        parent = node->getParent();
+                        continue;
+                    }
+
+                    if (!isRed(sibling->getRightChild())) {
+                        sibling->getLeftChild()->setRed(false);
+                        sibling->setRed(true);
+                        rotateRight(sibling);
+                        sibling = parent->getRightChild();
+                    }
+
+                    sibling->setRed(parent->isRed());
+                    parent->setRed(false);
+                    sibling->getRightChild()->setRed(false);
+                    rotateLeft(parent);
+                    node = root;
+                }
+                else {
+                    Node *sibling = parent->getLeftChild();
+
+                    if (isRed(sibling)) {
+                        sibling->setRed(false);
+                        parent->setRed(true);
+                        rotateRight(parent);
+                        sibling = parent->getLeftChild();
+                    }
+
+                    if (!isRed(sibling->getLeftChild()) && !isRed(sibling->getRightChild())) {
+                        sibling->setRed(true);
+                        node = parent;
+                        parent = node->getParent();
+                        continue;
+                    }
+
+                    if (!isRed(sibling->getLeftChild())) {
+                        sibling->getRightChild()->setRed(false);
+                        sibling->setRed(true);
+                        rotateLeft(sibling);
+                        sibling = parent->getLeftChild();
+                    }
+
+                    sibling->setRed(parent->isRed());
+                    parent->setRed(false);
+                    sibling->getLeftChild()->setRed(false);
+                    rotateRight(parent);
+                    node = root;
+                }
+            }
+
+            if (node != nullptr) node->setRed(false);
         }
 
         void remove(const const_iterator &it) {
@@ -238,6 +1100,13 @@ namespace aisdi {
             return (size_type) length;
         }
 
+        void clear() {
+            destroyNodes();
+            root = nullptr;
+            length = 0;
+            rebalanceCooldown = 0;
+        }
+
         bool operator==(const TreeMap &other) const {
             if (length != other.length) return false;
 
@@ -300,10 +1169,180 @@ namespace aisdi {
         const_iterator end() const {
             return cend();
         }
+
+        allocator_type getAllocator() const {
+            return allocator_type(nodeAllocator);
+        }
+
+        Node *cloneSubtree(Node *source, Node *parent) {
+            Node *node = createNode(parent, source->getValueType());
+            node->setRed(source->isRed());
+            node->setSubtreeSize(source->getSubtreeSize());
+
+            try {
+                if (source->getLeftChild() != nullptr)
+                    node->setLeftChild(cloneSubtree(source->getLeftChild(), node));
+                if (source->getRightChild() != nullptr)
+                    node->setRightChild(cloneSubtree(source->getRightChild(), node));
+            }
+            catch (...) {
+                destroySubtree(node);
+                throw;
+            }
+
+            return node;
+        }
+
+        // Replaces the (empty) tree with count sorted elements. Splitting at the
+        // middle fills every level but the last, which is coloured red.
+        template<typename InputIt>
+        void buildSorted(InputIt &first, size_type count) {
+            Node *previous = nullptr;
+            root = buildBalanced(first, count, 0, balancedRedDepth(count), previous);
+            length = (int) count;
+        }
+
+        // The one level of a balanced tree of count nodes that may be partly
+        // filled; colouring it red and the rest black is a valid colouring.
+        static int balancedRedDepth(size_type count) {
+            int redDepth = 0;
+            while (((size_type) 2 << redDepth) <= count + 1) ++redDepth;
+
+            return redDepth;
+        }
+
+        // rebalance's counterpart of buildBalanced: hangs the sorted nodes
+        // under each other in place and returns the subtree root.
+        Node *linkBalanced(Node **nodes, size_type count, int depth, int redDepth) {
+            if (count == 0) return nullptr;
+
+            size_type leftCount = (count - 1) / 2;
+            Node *node = nodes[leftCount];
+            Node *left = linkBalanced(nodes, leftCount, depth + 1, redDepth);
+            Node *right = linkBalanced(nodes + leftCount + 1, count - 1 - leftCount, depth + 1, redDepth);
+
+            node->setLeftChild(left);
+            if (left != nullptr) left->setParent(node);
+            node->setRightChild(right);
+            if (right != nullptr) right->setParent(node);
+            node->setRed(depth == redDepth);
+            node->setSubtreeSize(count);
+
+            return node;
+        }
+
+        template<typename InputIt>
+        Node *buildBalanced(InputIt &it, size_type count, int depth, int redDepth, Node *&previous) {
+            if (count == 0) return nullptr;
+
+            size_type leftCount = (count - 1) / 2;
+            Node *left = buildBalanced(it, leftCount, depth + 1, redDepth, previous);
+            Node *node;
+
+            try {
+                node = createNode(nullptr, *it);
+            }
+            catch (...) {
+                destroySubtree(left);
+                throw;
+            }
+
+            node->setLeftChild(left);
+            if (left != nullptr) left->setParent(node);
+            node->setRed(depth == redDepth);
+            node->setSubtreeSize(count);
+
+            try {
+                // advancing may throw too, e.g. when it decodes a stream
+                ++it;
+
+                if (previous != nullptr && !compare(previous->getKey(), node->getKey()))
+                    throw std::invalid_argument("");
+                previous = node;
+
+                Node *right = buildBalanced(it, count - 1 - leftCount, depth + 1, redDepth, previous);
+                node->setRightChild(right);
+                if (right != nullptr) right->setParent(node);
+            }
+            catch (...) {
+                destroySubtree(node);
+                throw;
+            }
+
+            return node;
+        }
+
+        void destroySubtree(Node *node) {
+            postOrder(node, [this](Node *leaf) { destroyNode(leaf); });
+        }
+
+        // Frees the whole tree in one pass. An allocator that owns its pool
+        // alone gives it back in one shot, so nodes only need visiting when
+        // their values have destructors.
+        void destroyNodes() {
+            bool bulk = detail::BulkRelease<NodeAllocator>::canRelease(nodeAllocator);
+
+            if (!bulk) destroySubtree(root);
+            else {
+                if (!std::is_trivially_destructible<value_type>::value)
+                    postOrder(root, [this](Node *leaf) { NodeTraits::destroy(nodeAllocator, leaf); });
+
+                detail::BulkRelease<NodeAllocator>::release(nodeAllocator);
+                AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.nodeFrees, length));
+            }
+        }
+
+        // Walks a subtree bottom-up, handing each node to visit once both of its
+        // children are gone. Progress is kept by unlinking visited leaves and
+        // climbing back through parent links, so no recursion or stack is used.
+        template<typename Visit>
+        void postOrder(Node *node, Visit visit) {
+            if (node == nullptr) return;
+
+            Node *stop = node->getParent();
+
+            while (node != stop) {
+                if (node->getLeftChild() != nullptr) node = node->getLeftChild();
+                else if (node->getRightChild() != nullptr) node = node->getRightChild();
+                else {
+                    Node *parent = node->getParent();
+
+                    if (parent != stop) {
+                        if (parent->getLeftChild() == node) parent->setLeftChild(nullptr);
+                        else parent->setRightChild(nullptr);
+                    }
+
+                    visit(node);
+                    node = parent;
+                }
+            }
+        }
+
+        template<typename... Args>
+        Node *createNode(Args &&... args) {
+            Node *node = NodeTraits::allocate(nodeAllocator, 1);
+
+            try {
+                NodeTraits::construct(nodeAllocator, node, std::forward<Args>(args)...);
+            }
+            catch (...) {
+                NodeTraits::deallocate(nodeAllocator, node, 1);
+                throw;
+            }
+
+            AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.nodeAllocations));
+            return node;
+        }
+
+        void destroyNode(Node *node) {
+            NodeTraits::destroy(nodeAllocator, node);
+            NodeTraits::deallocate(nodeAllocator, node, 1);
+            AISDI_MAPS_STAT(detail::StatsRecorder::add(statsRecorder.nodeFrees));
+        }
     };
 
-    template<typename KeyType, typename ValueType>
-    class TreeMap<KeyType, ValueType>::ConstIterator {
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    class TreeMap<KeyType, ValueType, Compare, Allocator>::ConstIterator {
     public:
         using reference = typename TreeMap::const_reference;
         using iterator_category = std::bidirectional_iterator_tag;
@@ -329,7 +1368,9 @@ namespace aisdi {
         }
 
         ConstIterator &operator++() {
+#if AISDI_MAPS_CHECKED_ITERATORS
             if (node == nullptr) throw std::out_of_range("");
+#endif
 
             if (node->getRightChild() != nullptr) {
 
@@ -361,9 +1402,9 @@ namespace aisdi {
             return it;
         }
 
+        // Mirrors operator++, so a full backward walk is amortized O(1) a
+        // step; only stepping back from end() walks down from the root.
         ConstIterator &operator--() {
-            if (*this == map->cbegin() || map->length <= 0) throw std::out_of_range("");
-
             if (this->node == nullptr){
                 Node * temp = map->root;
                 Node * parent = nullptr;
@@ -373,6 +1414,9 @@ namespace aisdi {
                     temp = temp->getRightChild();
                 }
 
+#if AISDI_MAPS_CHECKED_ITERATORS
+                if (parent == nullptr) throw std::out_of_range("");
+#endif
                 this->node = parent;
                 return *this;
             }
@@ -386,17 +1430,17 @@ namespace aisdi {
                 }
 
             } else {
+                Node *temp = node;
 
-                while (node->getParent() != nullptr && node->getParent()->getLeftChild() == node) {
-                    node = node->getParent();
-                }
-
-                if (node->getParent() != nullptr) {
-                    node = node->getParent();
-                } else {
-                    node = nullptr;
+                while (temp->getParent() != nullptr && temp->getParent()->getLeftChild() == temp) {
+                    temp = temp->getParent();
                 }
 
+#if AISDI_MAPS_CHECKED_ITERATORS
+                // no left turn above: this was begin()
+                if (temp->getParent() == nullptr) throw std::out_of_range("");
+#endif
+                node = temp->getParent();
             }
 
             return *this;
@@ -408,8 +1452,40 @@ namespace aisdi {
             return it;
         }
 
+        // Jumps by n positions in O(log n); end() counts as the position past
+        // the last element. Throws std::out_of_range when leaving [begin, end].
+        ConstIterator &operator+=(std::ptrdiff_t n) {
+            if (map == nullptr) throw std::out_of_range("");
+
+            std::ptrdiff_t target = (std::ptrdiff_t) map->indexOf(node) + n;
+            if (target < 0 || target > (std::ptrdiff_t) map->getSize()) throw std::out_of_range("");
+
+            node = map->selectNode((size_type) target);
+            return *this;
+        }
+
+        ConstIterator &operator-=(std::ptrdiff_t n) {
+            return *this += -n;
+        }
+
+        ConstIterator operator+(std::ptrdiff_t n) const {
+            ConstIterator it(*this);
+            return it += n;
+        }
+
+        ConstIterator operator-(std::ptrdiff_t n) const {
+            ConstIterator it(*this);
+            return it -= n;
+        }
+
+        std::ptrdiff_t operator-(const ConstIterator &other) const {
+            return (std::ptrdiff_t) map->indexOf(node) - (std::ptrdiff_t) map->indexOf(other.node);
+        }
+
         reference operator*() const {
+#if AISDI_MAPS_CHECKED_ITERATORS
             if (!node) throw std::out_of_range("");
+#endif
 
             return node->getValueType();
         }
@@ -418,9 +1494,8 @@ namespace aisdi {
             return &this->operator*();
         }
 
+        // A node is at one position only, and end() has no node.
         bool operator==(const ConstIterator &other) const {
-            if (this->map->getSize() != other.map->getSize()) return false;
-
             return node == other.node;
         }
 
@@ -429,8 +1504,8 @@ namespace aisdi {
         }
     };
 
-    template<typename KeyType, typename ValueType>
-    class TreeMap<KeyType, ValueType>::Iterator : public TreeMap<KeyType, ValueType>::ConstIterator {
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    class TreeMap<KeyType, ValueType, Compare, Allocator>::Iterator : public TreeMap<KeyType, ValueType, Compare, Allocator>::ConstIterator {
     public:
         using reference = typename TreeMap::reference;
         using pointer = typename TreeMap::value_type *;
@@ -462,6 +1537,28 @@ namespace aisdi {
             return result;
         }
 
+        using ConstIterator::operator-;
+
+        Iterator &operator+=(std::ptrdiff_t n) {
+            ConstIterator::operator+=(n);
+            return *this;
+        }
+
+        Iterator &operator-=(std::ptrdiff_t n) {
+            ConstIterator::operator-=(n);
+            return *this;
+        }
+
+        Iterator operator+(std::ptrdiff_t n) const {
+            Iterator it(*this);
+            return it += n;
+        }
+
+        Iterator operator-(std::ptrdiff_t n) const {
+            Iterator it(*this);
+            return it -= n;
+        }
+
         pointer operator->() const {
             return &this->operator*();
         }
@@ -472,28 +1569,21 @@ namespace aisdi {
         }
     };
 
-    template<typename KeyType, typename ValueType>
-    class TreeMap<KeyType, ValueType>::Node {
-        value_type *value;
+    template<typename KeyType, typename ValueType, typename Compare, typename Allocator>
+    class TreeMap<KeyType, ValueType, Compare, Allocator>::Node {
+        value_type value;
 
         Node *left;
         Node *right;
         Node *parent;
+        bool red;
+        size_type subtreeSize;
 
     public:
-        Node(){
-            value = nullptr;
-            left = right = parent = nullptr;
-        }
-
-        Node(const key_type key, mapped_type val, Node* parent): left(nullptr), right(nullptr), parent(parent)
-        {
-            value = new value_type(key, val);
-        }
-
-        ~Node() {
-            if (value) delete value;
-        }
+        template<typename... Args>
+        explicit Node(Node *parent, Args &&... args)
+                : value(std::forward<Args>(args)...), left(nullptr), right(nullptr), parent(parent), red(true),
+                  subtreeSize(1) {}
 
         Node *getParent() { return parent; }
 
@@ -507,31 +1597,19 @@ namespace aisdi {
 
         void setParent(Node *newParent) { parent = newParent; }
 
-        void setKey(key_type key) {
-            value_type *temp;
-
-            if (value)
-                temp = new value_type(key, value->second);
-            else
-                temp = new value_type(key, mapped_type{});
+        bool isRed() { return red; }
 
-            delete value;
-            value = temp;
-        }
+        void setRed(bool newRed) { red = newRed; }
 
-        void setValue(value_type val) {
-            value_type *temp = new value_type(val.first, val.second);
-            if (value)
-                delete value;
+        size_type getSubtreeSize() { return subtreeSize; }
 
-            value = temp;
-        }
+        void setSubtreeSize(size_type newSize) { subtreeSize = newSize; }
 
         bool hasChildren() { return (right != nullptr || left != nullptr); }
 
-        key_type getKey() { return value->first; }
+        const key_type &getKey() { return value.first; }
 
-        value_type& getValueType() { return *value; }
+        value_type& getValueType() { return value; }
     };
 
 }
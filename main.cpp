@@ -0,0 +1,397 @@
+// Profiling driver comparing TreeMap and HashMap (plus BTreeMap, FlatHashMap
+// and OrderedHashMap) with the std::map / std::unordered_map baselines. Every
+// (map, workload, key distribution, size) combination becomes one CSV or JSON
+// record with the time per operation, the allocations it made and the process
+// peak RSS.
+//
+//   ./maps --sizes=1e3,1e6 --maps=TreeMap,std::map --dists=random,zipf
+//          --workloads=insert,find-hit --format=json --repeat=3
+//
+// Profile a Release build only; Debug numbers say nothing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "BTreeMap.h"
+#include "FlatHashMap.h"
+#include "HashMap.h"
+#include "OrderedHashMap.h"
+#include "TreeMap.h"
+
+namespace {
+
+    std::size_t allocationCount = 0;
+    std::size_t allocationBytes = 0;
+
+}
+
+// Counting replacements for the global allocation functions. Kept out of line
+// so GCC does not pair the inlined malloc/free with the std allocators and
+// report them as mismatched.
+[[gnu::noinline]] void *operator new(std::size_t size) {
+    ++allocationCount;
+    allocationBytes += size;
+
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    using Key = std::uint64_t;
+    using Value = std::uint64_t;
+
+    // Bijective mixer, so distinct indices give distinct, well spread keys.
+    Key splitMix(Key x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // Gray et al. "Quickly generating billion-record synthetic databases";
+    // the generator YCSB uses. Rank 0 is the hottest.
+    class ZipfGenerator {
+    public:
+        ZipfGenerator(std::size_t n, double theta, std::uint64_t seed)
+                : n(n), theta(theta), state(seed) {
+            double zeta2 = 1.0 + std::pow(0.5, theta);
+            zetan = 0.0;
+            for (std::size_t i = 1; i <= n; ++i) zetan += 1.0 / std::pow((double) i, theta);
+
+            alpha = 1.0 / (1.0 - theta);
+            eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        }
+
+        std::size_t next() {
+            double u = uniform();
+            double uz = u * zetan;
+
+            if (uz < 1.0) return 0;
+            if (uz < 1.0 + std::pow(0.5, theta)) return n > 1 ? 1 : 0;
+
+            std::size_t rank = (std::size_t) (n * std::pow(eta * u - eta + 1.0, alpha));
+            return rank < n ? rank : n - 1;
+        }
+
+    private:
+        double uniform() {
+            state = splitMix(state);
+            return (state >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        std::size_t n;
+        double theta;
+        double zetan;
+        double alpha;
+        double eta;
+        std::uint64_t state;
+    };
+
+    // Keys present in the map (in insertion order), lookups over them in
+    // access order, and keys guaranteed to be absent.
+    struct KeySet {
+        std::vector<Key> present;
+        std::vector<Key> lookups;
+        std::vector<Key> missing;
+    };
+
+    KeySet makeKeys(const std::string &distribution, std::size_t n) {
+        KeySet keys;
+        keys.present.resize(n);
+        keys.lookups.resize(n);
+        keys.missing.resize(n);
+
+        if (distribution == "sequential") {
+            for (std::size_t i = 0; i < n; ++i) {
+                keys.present[i] = i;
+                keys.lookups[i] = i;
+                keys.missing[i] = n + i;
+            }
+
+            return keys;
+        }
+
+        for (std::size_t i = 0; i < n; ++i) {
+            keys.present[i] = splitMix(i);
+            keys.missing[i] = splitMix(n + i);
+        }
+
+        if (distribution == "zipf") {
+            ZipfGenerator zipf(n, 0.99, 42);
+            for (std::size_t i = 0; i < n; ++i) keys.lookups[i] = keys.present[zipf.next()];
+        }
+        else {
+            std::uint64_t state = 7;
+            for (std::size_t i = 0; i < n; ++i) {
+                state = splitMix(state);
+                keys.lookups[i] = keys.present[state % n];
+            }
+        }
+
+        return keys;
+    }
+
+    // The aisdi maps say remove() where the std ones say erase().
+    template<typename Map>
+    auto eraseKey(Map &map, Key key, int) -> decltype(map.erase(key), void()) {
+        map.erase(key);
+    }
+
+    template<typename Map>
+    auto eraseKey(Map &map, Key key, long) -> decltype(map.remove(key), void()) {
+        map.remove(key);
+    }
+
+    struct Measurement {
+        double nsPerOp;
+        std::size_t operations;
+        std::size_t allocations;
+        std::size_t allocatedBytes;
+    };
+
+    long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return -1;
+#endif
+    }
+
+    volatile Value sink;
+
+    template<typename Setup, typename Body>
+    Measurement measure(std::size_t operations, Setup setup, Body body) {
+        setup();
+
+        std::size_t allocationsBefore = allocationCount;
+        std::size_t bytesBefore = allocationBytes;
+        auto start = std::chrono::steady_clock::now();
+
+        body();
+
+        auto stop = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+
+        return Measurement{ns / (operations ? operations : 1), operations,
+                           allocationCount - allocationsBefore, allocationBytes - bytesBefore};
+    }
+
+    template<typename Map>
+    void fill(Map &map, const std::vector<Key> &keys) {
+        for (std::size_t i = 0; i < keys.size(); ++i) map[keys[i]] = i;
+    }
+
+    template<typename Map>
+    Measurement runWorkload(const std::string &workload, const KeySet &keys) {
+        std::size_t n = keys.present.size();
+        Map map;
+        Value checksum = 0;
+
+        if (workload == "insert") {
+            return measure(n, [&] { map = Map(); }, [&] { fill(map, keys.present); });
+        }
+
+        fill(map, keys.present);
+
+        if (workload == "find-hit") {
+            auto result = measure(n, [] {}, [&] {
+                for (Key key : keys.lookups) checksum += map.find(key)->second;
+            });
+            sink = checksum;
+            return result;
+        }
+
+        if (workload == "find-miss") {
+            auto result = measure(n, [] {}, [&] {
+                for (Key key : keys.missing) checksum += map.find(key) == map.end();
+            });
+            sink = checksum;
+            return result;
+        }
+
+        if (workload == "erase") {
+            return measure(n, [] {}, [&] {
+                for (Key key : keys.present) eraseKey(map, key, 0);
+            });
+        }
+
+        if (workload == "iterate") {
+            auto result = measure(n, [] {}, [&] {
+                for (auto it = map.begin(); it != map.end(); ++it) checksum += it->second;
+            });
+            sink = checksum;
+            return result;
+        }
+
+        if (workload == "copy") {
+            return measure(n, [] {}, [&] {
+                Map copy(map);
+                sink = copy.find(keys.present[0])->second;
+            });
+        }
+
+        throw std::invalid_argument("unknown workload " + workload);
+    }
+
+    struct Options {
+        std::vector<std::size_t> sizes{1000, 10000, 100000, 1000000};
+        std::vector<std::string> maps{"TreeMap", "BTreeMap", "HashMap", "FlatHashMap", "OrderedHashMap", "std::map", "std::unordered_map"};
+        std::vector<std::string> distributions{"sequential", "random", "zipf"};
+        std::vector<std::string> workloads{"insert", "find-hit", "find-miss", "erase", "iterate", "copy"};
+        std::string format = "csv";
+        int repeat = 1;
+    };
+
+    std::vector<std::string> splitList(const std::string &list) {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) items.push_back(item);
+        }
+
+        return items;
+    }
+
+    void checkNames(const std::vector<std::string> &names, const std::vector<std::string> &known,
+                    const std::string &kind) {
+        for (const std::string &name : names) {
+            if (std::find(known.begin(), known.end(), name) == known.end())
+                throw std::invalid_argument("unknown " + kind + " " + name);
+        }
+    }
+
+    Options parseOptions(int argc, char **argv) {
+        Options options;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::size_t eq = arg.find('=');
+            std::string name = arg.substr(0, eq);
+            std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+            if (name == "--sizes") {
+                options.sizes.clear();
+                for (const std::string &size : splitList(value)) options.sizes.push_back((std::size_t) std::stod(size));
+            }
+            else if (name == "--maps") options.maps = splitList(value);
+            else if (name == "--dists") options.distributions = splitList(value);
+            else if (name == "--workloads") options.workloads = splitList(value);
+            else if (name == "--format") options.format = value;
+            else if (name == "--repeat") options.repeat = std::max(1, std::atoi(value.c_str()));
+            else throw std::invalid_argument("unknown option " + arg);
+        }
+
+        // the defaults list everything there is; checking now fails before
+        // any output instead of halfway through the run
+        Options all;
+        checkNames(options.maps, all.maps, "map");
+        checkNames(options.distributions, all.distributions, "distribution");
+        checkNames(options.workloads, all.workloads, "workload");
+
+        return options;
+    }
+
+    Measurement runMap(const std::string &map, const std::string &workload, const KeySet &keys) {
+        if (map == "TreeMap") return runWorkload<aisdi::TreeMap<Key, Value>>(workload, keys);
+        if (map == "BTreeMap") return runWorkload<aisdi::BTreeMap<Key, Value>>(workload, keys);
+        if (map == "HashMap") return runWorkload<aisdi::HashMap<Key, Value>>(workload, keys);
+        if (map == "FlatHashMap") return runWorkload<aisdi::FlatHashMap<Key, Value>>(workload, keys);
+        if (map == "OrderedHashMap") return runWorkload<aisdi::OrderedHashMap<Key, Value>>(workload, keys);
+        if (map == "std::map") return runWorkload<std::map<Key, Value>>(workload, keys);
+        if (map == "std::unordered_map") return runWorkload<std::unordered_map<Key, Value>>(workload, keys);
+
+        throw std::invalid_argument("unknown map " + map);
+    }
+
+}
+
+int main(int argc, char **argv) {
+    Options options;
+
+    try {
+        options = parseOptions(argc, argv);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    bool json = options.format == "json";
+    bool first = true;
+
+    if (json) std::cout << "[\n";
+    else std::cout << "map,workload,distribution,size,operations,ns_per_op,allocations,allocated_bytes,peak_rss_kb\n";
+
+    for (std::size_t size : options.sizes) {
+        for (const std::string &distribution : options.distributions) {
+            KeySet keys = makeKeys(distribution, size);
+
+            for (const std::string &map : options.maps) {
+                for (const std::string &workload : options.workloads) {
+                    Measurement best{};
+
+                    for (int run = 0; run < options.repeat; ++run) {
+                        Measurement m = runMap(map, workload, keys);
+                        if (run == 0 || m.nsPerOp < best.nsPerOp) best = m;
+                    }
+
+                    if (json) {
+                        std::cout << (first ? "" : ",\n")
+                                  << "  {\"map\": \"" << map << "\", \"workload\": \"" << workload
+                                  << "\", \"distribution\": \"" << distribution << "\", \"size\": " << size
+                                  << ", \"operations\": " << best.operations << ", \"ns_per_op\": " << best.nsPerOp
+                                  << ", \"allocations\": " << best.allocations
+                                  << ", \"allocated_bytes\": " << best.allocatedBytes
+                                  << ", \"peak_rss_kb\": " << peakRssKb() << "}";
+                    }
+                    else {
+                        std::cout << map << ',' << workload << ',' << distribution << ',' << size << ','
+                                  << best.operations << ',' << best.nsPerOp << ',' << best.allocations << ','
+                                  << best.allocatedBytes << ',' << peakRssKb() << "\n";
+                    }
+
+                    first = false;
+                    std::cout.flush();
+                }
+            }
+        }
+    }
+
+    if (json) std::cout << "\n]\n";
+
+    return 0;
+}
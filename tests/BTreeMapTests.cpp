@@ -0,0 +1,137 @@
+#include <cstddef>
+#include <map>
+#include <new>
+#include <utility>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "BTreeMap.h"
+
+namespace
+{
+
+// Allocates normally until allocationsLeft runs out, then throws std::bad_alloc.
+// A negative budget never runs out.
+long allocationsLeft = -1;
+
+template <typename T>
+struct ThrowingAllocator
+{
+  using value_type = T;
+
+  ThrowingAllocator() = default;
+
+  template <typename U>
+  ThrowingAllocator(const ThrowingAllocator<U>&) {}
+
+  T* allocate(std::size_t n)
+  {
+    if (allocationsLeft == 0)
+      throw std::bad_alloc();
+    if (allocationsLeft > 0)
+      --allocationsLeft;
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, std::size_t n)
+  {
+    std::allocator<T>().deallocate(p, n);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const ThrowingAllocator<T>&, const ThrowingAllocator<U>&)
+{
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const ThrowingAllocator<T>&, const ThrowingAllocator<U>&)
+{
+  return false;
+}
+
+using Map = aisdi::BTreeMap<int, int, std::less<int>, ThrowingAllocator<std::pair<const int, int>>>;
+
+void checkSameAs(const Map& map, const std::map<int, int>& expected)
+{
+  BOOST_CHECK_EQUAL(map.getSize(), expected.size());
+
+  std::size_t walked = 0;
+  auto it = expected.begin();
+  for (auto mapIt = map.begin(); mapIt != map.end() && it != expected.end(); ++mapIt, ++it, ++walked)
+  {
+    BOOST_CHECK_EQUAL(mapIt->first, it->first);
+    BOOST_CHECK_EQUAL(mapIt->second, it->second);
+  }
+  BOOST_CHECK_EQUAL(walked, expected.size());
+
+  for (const auto& element : expected)
+    BOOST_CHECK(map.contains(element.first));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(GivenFailingSplitAllocation_WhenInserting_ThenMapIsUnchanged)
+{
+  Map map;
+  std::map<int, int> expected;
+  std::size_t failures = 0;
+
+  // the first leaf, then the new leaf of the first split; its new root fails
+  allocationsLeft = 2;
+  for (int key = 0; key < 200; ++key)
+  {
+    try
+    {
+      map[key] = key;
+      expected[key] = key;
+    }
+    catch (const std::bad_alloc&)
+    {
+      ++failures;
+    }
+  }
+  allocationsLeft = -1;
+
+  BOOST_CHECK(failures > 0);
+  checkSameAs(map, expected);
+
+  for (int key = 0; key < 200; ++key)
+    map[key] = expected[key] = key;
+  checkSameAs(map, expected);
+}
+
+BOOST_AUTO_TEST_CASE(GivenAllocationFailingAtEveryStep_WhenInserting_ThenMapStaysConsistent)
+{
+  Map map;
+  std::map<int, int> expected;
+  std::size_t failures = 0;
+
+  for (int i = 0; i < 20000; ++i)
+  {
+    int key = i * 7919 % 20000;
+
+    // allow one more allocation per attempt, so every split fails once after
+    // each of the nodes it takes
+    for (long budget = 0; ; ++budget)
+    {
+      allocationsLeft = budget;
+      try
+      {
+        map[key] = i;
+        break;
+      }
+      catch (const std::bad_alloc&)
+      {
+        ++failures;
+      }
+    }
+    expected[key] = i;
+  }
+  allocationsLeft = -1;
+
+  BOOST_CHECK(failures > 0);
+  checkSameAs(map, expected);
+}
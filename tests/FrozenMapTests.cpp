@@ -0,0 +1,44 @@
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "FrozenMap.h"
+
+namespace
+{
+
+using Elements = std::vector<std::pair<const int, int>>;
+using FrozenTree = aisdi::FrozenTreeMap<int, int>;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(GivenSortedElements_WhenFreezing_ThenEveryKeyIsFound)
+{
+  Elements elements;
+  for (int key = 0; key < 100; ++key)
+    elements.emplace_back(key * 2, key);
+
+  FrozenTree map(elements.begin(), elements.end());
+
+  BOOST_CHECK_EQUAL(map.getSize(), elements.size());
+  for (const auto& element : elements)
+    BOOST_CHECK_EQUAL(map.valueOf(element.first), element.second);
+  BOOST_CHECK(!map.contains(1));
+}
+
+BOOST_AUTO_TEST_CASE(GivenUnsortedElements_WhenFreezing_ThenExceptionIsThrown)
+{
+  Elements elements{{1, 1}, {3, 3}, {2, 2}};
+
+  BOOST_CHECK_THROW(FrozenTree(elements.begin(), elements.end()), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(GivenDuplicateKeys_WhenFreezing_ThenExceptionIsThrown)
+{
+  Elements elements{{1, 1}, {2, 2}, {2, 3}};
+
+  BOOST_CHECK_THROW(FrozenTree(elements.begin(), elements.end()), std::invalid_argument);
+}